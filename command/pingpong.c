@@ -0,0 +1,83 @@
+#include "type.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/const.h"
+#include "sys/protect.h"
+#include "sys/fs.h"
+#include "sys/proc.h"
+#include "sys/tty.h"
+#include "sys/console.h"
+#include "sys/proto.h"
+
+/*****************************************************************************
+ *                                rpc_two_traps
+ *****************************************************************************/
+/**
+ * One round trip to TASK_SYS the old way: a SEND trap and a RECEIVE trap.
+ *****************************************************************************/
+PRIVATE void rpc_two_traps()
+{
+	MESSAGE msg;
+	msg.type = GET_PID;
+	sendrec(SEND, TASK_SYS, &msg);
+	sendrec(RECEIVE, TASK_SYS, &msg);
+}
+
+/*****************************************************************************
+ *                                rpc_fused
+ *****************************************************************************/
+/**
+ * One round trip to TASK_SYS with a single BOTH trap.
+ *****************************************************************************/
+PRIVATE void rpc_fused()
+{
+	MESSAGE msg;
+	msg.type = GET_PID;
+	sendrec(BOTH, TASK_SYS, &msg);
+}
+
+/*****************************************************************************
+ *                                bench
+ *****************************************************************************/
+/**
+ * Time n round trips.
+ * 
+ * @return Nanoseconds per round trip.
+ *****************************************************************************/
+PRIVATE u32 bench(void (*rpc)(), int n)
+{
+	int i;
+	u64 t = clock_ns();
+
+	for (i = 0; i < n; i++)
+		rpc();
+
+	t = clock_ns() - t;
+	div64(&t, n);
+	return (u32)t;
+}
+
+/*****************************************************************************
+ *                                main
+ *****************************************************************************/
+/**
+ * pingpong [n]: compare the cost of an RPC done with two traps and with
+ * one (n round trips each, 10000 by default).
+ *****************************************************************************/
+int main(int argc, char * argv[])
+{
+	int n = 10000;
+
+	if (argc > 1) {
+		char * p = argv[1];
+		for (n = 0; *p >= '0' && *p <= '9'; p++)
+			n = n * 10 + *p - '0';
+	}
+	if (n <= 0)
+		n = 1;
+
+	printf("SEND + RECEIVE: %8d ns/rpc\n", bench(rpc_two_traps, n));
+	printf("BOTH          : %8d ns/rpc\n", bench(rpc_fused, n));
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+#include "type.h"
+#include "stdio.h"
+#include "string.h"
+#include "sys/const.h"
+#include "sys/protect.h"
+#include "sys/fs.h"
+#include "sys/proc.h"
+#include "sys/tty.h"
+#include "sys/console.h"
+#include "sys/proto.h"
+
+#define	NR_SLOTS	(NR_TASKS + NR_PROCS)
+
+struct proc_stat	ps[2][NR_SLOTS];
+
+/*****************************************************************************
+ *                                state
+ *****************************************************************************/
+/**
+ * One char telling what a proc is doing.
+ *****************************************************************************/
+PRIVATE char state(int flags)
+{
+	if (flags == 0)		return 'R';	/* runnable */
+	if (flags & HANGING)	return 'Z';
+	if (flags & WAITING)	return 'W';
+	if (flags & SENDING)	return 'S';
+	if (flags & RECEIVING)	return 'r';
+	return '?';
+}
+
+/*****************************************************************************
+ *                                show
+ *****************************************************************************/
+/**
+ * Print the difference between two snapshots.
+ *
+ * @param old  The previous snapshot.
+ * @param new  The current snapshot.
+ * @param nr   How many slots are in the snapshots.
+ * @param dt   Ticks elapsed between the two snapshots.
+ *****************************************************************************/
+PRIVATE void show(struct proc_stat * old, struct proc_stat * new, int nr, int dt)
+{
+	int i;
+	char name[16];
+
+	printf("\n PID NAME         S PRI CPU%%   USR   SYS  VCSW  ICSW"
+	       "  SENT  RECV SWAIT RWAIT\n");
+
+	for (i = 0; i < nr; i++, old++, new++) {
+		if (new->p_flags == FREE_SLOT)
+			continue;
+
+		/* printf() knows nothing about left alignment */
+		memset(name, ' ', sizeof(name));
+		memcpy(name, new->name, min(strlen(new->name), 12));
+		name[12] = 0;
+
+		int cpu = new->user_ticks + new->sys_ticks -
+			old->user_ticks - old->sys_ticks;
+
+		printf("%4d %s %c %3d %4d %5d %5d %5d %5d %5d %5d %5d %5d\n",
+		       i, name, state(new->p_flags), new->prio,
+		       dt ? cpu * 100 / dt : 0,
+		       new->user_ticks - old->user_ticks,
+		       new->sys_ticks - old->sys_ticks,
+		       new->nr_vol_sw - old->nr_vol_sw,
+		       new->nr_invol_sw - old->nr_invol_sw,
+		       new->nr_sent - old->nr_sent,
+		       new->nr_recv - old->nr_recv,
+		       new->send_ticks - old->send_ticks,
+		       new->recv_ticks - old->recv_ticks);
+	}
+}
+
+/*****************************************************************************
+ *                                main
+ *****************************************************************************/
+/**
+ * top [n]: show what every proc has done in the last second, n times
+ * (5 by default).
+ *****************************************************************************/
+int main(int argc, char * argv[])
+{
+	int n = 5;
+	int cur = 0;
+
+	if (argc > 1) {
+		char * p = argv[1];
+		for (n = 0; *p >= '0' && *p <= '9'; p++)
+			n = n * 10 + *p - '0';
+	}
+
+	int t = get_ticks();
+	int nr = getpstat(ps[cur], NR_SLOTS);
+
+	while (n--) {
+		int t0 = t;
+		sleep(1);
+		t = get_ticks();
+
+		cur = !cur;
+		nr = getpstat(ps[cur], NR_SLOTS);
+		show(ps[!cur], ps[cur], nr, t - t0);
+	}
+
+	return 0;
+}
@@ -161,11 +161,10 @@ PUBLIC int disklog(char * logstr)
 		p += bytes;
 	}
 
+	struct timeval tv;
 	struct time t;
-	MESSAGE msg;
-	msg.type = GET_RTC_TIME;
-	msg.BUF= &t;
-	send_recv(BOTH, TASK_SYS, &msg);
+	gettimeofday(&tv);
+	sec2time(tv.tv_sec, &t);
 
 	/* write `pos' and time into the log file header */
 	DISKLOG_RD_SECT(device, nr_log_blk0_nr);
@@ -191,6 +190,54 @@ PUBLIC int disklog(char * logstr)
 	return pos;
 }
 
+/*****************************************************************************
+ *                                do_trace_dump
+ *****************************************************************************/
+/**
+ * <Ring 1> Write the IPC trace ring into the log sectors, at TRACE_LOG_OFF:
+ * a struct trace_hdr in the first sector, then trace_ring[] as it is.
+ * Recording goes on, the ring is copied with interrupts disabled.
+ * 
+ * @return How many records are valid.
+ *****************************************************************************/
+PUBLIC int do_trace_dump()
+{
+	int device = root_inode->i_dev;
+	struct super_block * sb = get_super_block(device);
+	int trace_blk0_nr = sb->nr_sects - NR_SECTS_FOR_LOG + TRACE_LOG_OFF;
+
+	/* the first disklog() sets the log sectors up, and wipes them out */
+	disklog("");
+
+	struct trace_hdr * h = (struct trace_hdr *)logdiskbuf;
+	struct kinfo k;
+	get_kinfo(&k);
+
+	memset(logdiskbuf, 0, SECTOR_SIZE);
+	memcpy(h->th_magic, "IPCTRACE", sizeof(h->th_magic));
+	h->th_nr_recs = NR_TRACE_RECS;
+	h->th_boot_tsc = k.boot_tsc;
+	h->th_tsc_mult = k.tsc_mult;
+	h->th_tsc_shift = k.tsc_shift;
+
+	u32 eflags = save_and_disable_int();
+	h->th_cnt = trace_cnt;
+	memcpy(logdiskbuf + SECTOR_SIZE, trace_ring,
+	       NR_TRACE_RECS * sizeof(struct trace_rec));
+	restore_int(eflags);
+
+	assert(TRACE_LOG_SECTS * SECTOR_SIZE ==
+	       SECTOR_SIZE + NR_TRACE_RECS * sizeof(struct trace_rec));
+	rw_sector(DEV_WRITE,
+		  device,
+		  trace_blk0_nr * SECTOR_SIZE,
+		  TRACE_LOG_SECTS * SECTOR_SIZE,
+		  getpid(),
+		  logdiskbuf);
+
+	return min(h->th_cnt, NR_TRACE_RECS);
+}
+
 /* /\***************************************************************************** */
 /*  *                                inode2filename */
 /*  *****************************************************************************\/ */
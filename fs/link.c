@@ -79,6 +79,9 @@ PUBLIC int do_unlink()
 
 	struct super_block * sb = get_super_block(pin->i_dev);
 
+	/* imap, smap, i-node and dir sectors go to the driver at once */
+	begin_batch();
+
 	/*************************/
 	/* free the bit in i-map */
 	/*************************/
@@ -206,5 +209,8 @@ PUBLIC int do_unlink()
 		sync_inode(dir_inode);
 	}
 
+	if (end_batch() != 0)
+		return -1;
+
 	return 0;
 }
@@ -27,103 +27,560 @@ PRIVATE void mkfs();
 PRIVATE void read_super_block(int dev);
 PRIVATE int fs_fork();
 PRIVATE int fs_exit();
+PRIVATE int flush_batch();
+PRIVATE void fs_serve();
+PRIVATE void init_fs_reqs();
+PRIVATE void req_main();
+PRIVATE void resume_req(struct fs_req * r);
+PRIVATE int  route_reply(MESSAGE * m);
+PRIVATE void fs_drv_track(int drv, MESSAGE * m);
+PRIVATE void fs_drv_submit_vec(int n, int * dests, MESSAGE * msgs);
+
+/* sector writes held back by begin_batch(), @see end_batch() */
+PRIVATE struct {
+	int	dev;
+	int	sect_nr;
+	u8	buf[SECTOR_SIZE];
+} batch[NR_BATCH_SECTS];
+PRIVATE int batch_cnt;
+PRIVATE int batch_depth;
+PRIVATE int batch_err;		/* a flush in the batch has failed */
+
+PRIVATE struct svc_stat fs_svc[NR_SVC_TYPES];
+
+PRIVATE struct fs_req	fs_main;	/* task_fs() itself, and init_fs() */
+PRIVATE struct fs_req	fs_reqs[NR_FS_REQS];
+
+/* driver requests sent but not done, @see fs_drv_submit() */
+PRIVATE struct {
+	MESSAGE *	msg;	/* 0 if the slot is free */
+	int		drv;
+} fs_inflight[NR_DRV_INFLIGHT];
+PRIVATE int fs_nr_inflight;
+
+/* RESUME_PROCs got while waiting for a reply, @see fs_chr_call() */
+PRIVATE MESSAGE	fs_resumes[NR_CONSOLES];
+PRIVATE int	fs_nr_resumes;
 
 /*****************************************************************************
  *                                task_fs
  *****************************************************************************/
 /**
  * <Ring 1> The main loop of TASK FS.
+ *
+ * Each request is served by a struct fs_req on a stack of its own. When a
+ * request has to wait for a driver to transfer file data, it is parked
+ * (@see fs_drv_wait()) and FS goes back to RECEIVE, so that other requests,
+ * most of which need no disk I/O or only a little, are not held up behind a
+ * long READ or WRITE. The parked request is resumed when its reply comes.
  * 
  *****************************************************************************/
 PUBLIC void task_fs()
 {
 	printl("{FS} Task FS begins.\n");
 
+	fs_main.buf = fsbuf_area;
+	fs_main.buf_size = FSBUF_SIZE;
+	fs_cur = &fs_main;
+
 	init_fs();
+	init_fs_reqs();
 
 	while (1) {
-		send_recv(RECEIVE, ANY, &fs_msg);
+		MESSAGE msg;
+		struct fs_req * r;
+
+		for (r = fs_reqs; r < fs_reqs + NR_FS_REQS; r++)
+			if (r->state == REQ_READY)
+				break;
+		if (r < fs_reqs + NR_FS_REQS) {
+			resume_req(r);
+			continue;
+		}
 
-		int msgtype = fs_msg.type;
-		int src = fs_msg.source;
-		pcaller = &proc_table[src];
+		for (r = fs_reqs; r < fs_reqs + NR_FS_REQS; r++)
+			if (r->state == REQ_FREE)
+				break;
+		if (r == fs_reqs + NR_FS_REQS) {
+			/* all are parked or waiting for an inode which a
+			 * parked one has locked, wait for a reply */
+			for (r = fs_reqs; r->state != REQ_PARKED; r++)
+				assert(r < fs_reqs + NR_FS_REQS - 1);
+			send_recv(RECEIVE, r->drv, &msg);
+			int routed = route_reply(&msg);
+			assert(routed);
+			continue;
+		}
 
-		switch (msgtype) {
-		case OPEN:
-			fs_msg.FD = do_open();
-			break;
-		case CLOSE:
-			fs_msg.RETVAL = do_close();
-			break;
-		case READ:
-		case WRITE:
-			fs_msg.CNT = do_rdwt();
-			break;
-		case UNLINK:
-			fs_msg.RETVAL = do_unlink();
-			break;
-		case RESUME_PROC:
-			src = fs_msg.PROC_NR;
-			break;
-		case FORK:
-			fs_msg.RETVAL = fs_fork();
-			break;
-		case EXIT:
-			fs_msg.RETVAL = fs_exit();
-			break;
-		case LSEEK:
-			fs_msg.OFFSET = do_lseek();
-			break;
-		case STAT:
-			fs_msg.RETVAL = do_stat();
-			break;
-		default:
-			dump_msg("FS::unknown message:", &fs_msg);
-			assert(0);
-			break;
+		if (fs_nr_resumes) {
+			int i;
+			msg = fs_resumes[0];
+			for (i = 1; i < fs_nr_resumes; i++)
+				fs_resumes[i - 1] = fs_resumes[i];
+			fs_nr_resumes--;
+		}
+		else {
+			send_recv(RECEIVE, ANY, &msg);
+			if (route_reply(&msg))
+				continue;
 		}
 
+		r->msg = msg;
+		r->caller = &proc_table[msg.source];
+		resume_req(r);
+	}
+}
+
+/*****************************************************************************
+ *                                fs_serve
+ *****************************************************************************/
+/**
+ * <Ring 1> Serve the request in fs_msg, and reply.
+ * 
+ *****************************************************************************/
+PRIVATE void fs_serve()
+{
+	int msgtype = fs_msg.type;
+	int src = fs_msg.source;
+	int reply = 1;
+
+	u64 t0;
+	struct svc_stat * svc = svc_begin(fs_svc, msgtype, &t0);
+
+	switch (msgtype) {
+	case OPEN:
+		fs_msg.FD = do_open();
+		break;
+	case CLOSE:
+		fs_msg.RETVAL = do_close();
+		break;
+	case READ:
+	case WRITE:
+		fs_msg.CNT = do_rdwt();
+		break;
+	case UNLINK:
+		fs_msg.RETVAL = do_unlink();
+		break;
+	case RESUME_PROC:
+		src = fs_msg.PROC_NR;
+		break;
+	case FORK:
+		fs_msg.RETVAL = fs_fork();
+		break;
+	case EXIT:
+		fs_msg.RETVAL = fs_exit();
+		break;
+	case LSEEK:
+		fs_msg.OFFSET = do_lseek();
+		break;
+	case STAT:
+		fs_msg.RETVAL = do_stat();
+		break;
+	case TRACE_DUMP:
+		fs_msg.RETVAL = do_trace_dump();
+		break;
+	case SVC_STAT:
+		fs_msg.CNT = svc_query(fs_svc, &fs_msg);
+		break;
+	case RING_SETUP:
+		fs_msg.RETVAL = do_ring_setup();
+		break;
+	case RING_ENTER:
+		/* a doorbell alone is not replied */
+		reply = fs_msg.FLAGS & RING_WAIT;
+		fs_msg.CNT = do_ring_enter();
+		break;
+	default:
+		dump_msg("FS::unknown message:", &fs_msg);
+		assert(0);
+		break;
+	}
+
 #ifdef ENABLE_DISK_LOG
-		char * msg_name[128];
-		msg_name[OPEN]   = "OPEN";
-		msg_name[CLOSE]  = "CLOSE";
-		msg_name[READ]   = "READ";
-		msg_name[WRITE]  = "WRITE";
-		msg_name[LSEEK]  = "LSEEK";
-		msg_name[UNLINK] = "UNLINK";
-		msg_name[FORK]   = "FORK";
-		msg_name[EXIT]   = "EXIT";
-		msg_name[STAT]   = "STAT";
-
-		switch (msgtype) {
-		case UNLINK:
-			dump_fd_graph("%s just finished. (pid:%d)",
-				      msg_name[msgtype], src);
-			//panic("");
-		case OPEN:
-		case CLOSE:
-		case READ:
-		case WRITE:
-		case FORK:
-		case EXIT:
-		case LSEEK:
-		case STAT:
+	char * msg_name[128];
+	msg_name[OPEN]   = "OPEN";
+	msg_name[CLOSE]  = "CLOSE";
+	msg_name[READ]   = "READ";
+	msg_name[WRITE]  = "WRITE";
+	msg_name[LSEEK]  = "LSEEK";
+	msg_name[UNLINK] = "UNLINK";
+	msg_name[FORK]   = "FORK";
+	msg_name[EXIT]   = "EXIT";
+	msg_name[STAT]   = "STAT";
+
+	switch (msgtype) {
+	case UNLINK:
+		dump_fd_graph("%s just finished. (pid:%d)",
+			      msg_name[msgtype], src);
+		//panic("");
+	case OPEN:
+	case CLOSE:
+	case READ:
+	case WRITE:
+	case FORK:
+	case EXIT:
+	case LSEEK:
+	case STAT:
+	case TRACE_DUMP:
+	case SVC_STAT:
+	case RING_SETUP:
+	case RING_ENTER:
+		break;
+	case RESUME_PROC:
+		break;
+	default:
+		assert(0);
+	}
+#endif
+
+	svc_end(svc, t0);
+
+	/* reply */
+	if (reply && fs_msg.type != SUSPEND_PROC) {
+		fs_msg.type = SYSCALL_RET;
+		send_async(src, &fs_msg);
+	}
+}
+
+/*****************************************************************************
+ *                                init_fs_reqs
+ *****************************************************************************/
+/**
+ * <Ring 1> Give each fs_req its part of the FS buffer, and get its stack
+ * ready to enter req_main() when it is resumed the first time.
+ * 
+ *****************************************************************************/
+PRIVATE void init_fs_reqs()
+{
+	struct fs_req * r;
+	int size = FSBUF_SIZE / NR_FS_REQS;
+
+	for (r = fs_reqs; r < fs_reqs + NR_FS_REQS; r++) {
+		u32 * sp = (u32*)(r->stack + FS_REQ_STACK);
+
+		*--sp = 0;		/* req_main() never returns */
+		*--sp = (u32)req_main;	/* where switch_stack() returns */
+		*--sp = 0;		/* ebp */
+		*--sp = 0;		/* ebx */
+		*--sp = 0;		/* esi */
+		*--sp = 0;		/* edi */
+
+		r->esp = (u32)sp;
+		r->buf = fsbuf_area + (r - fs_reqs) * size;
+		r->buf_size = size;
+		r->state = REQ_FREE;
+	}
+}
+
+/*****************************************************************************
+ *                                req_main
+ *****************************************************************************/
+/**
+ * <Ring 1> What an fs_req does all its life: serve the request given by
+ * task_fs(), then wait for the next one.
+ * 
+ *****************************************************************************/
+PRIVATE void req_main()
+{
+	while (1) {
+		fs_serve();
+
+		fs_cur->state = REQ_FREE;
+		switch_stack(&fs_cur->esp, fs_main.esp);
+	}
+}
+
+/*****************************************************************************
+ *                                resume_req
+ *****************************************************************************/
+/**
+ * <Ring 1> Run an fs_req until it is done or parked.
+ * 
+ * @param r  The fs_req, with a new request or a reply.
+ *****************************************************************************/
+PRIVATE void resume_req(struct fs_req * r)
+{
+	r->state = REQ_RUNNING;
+	fs_cur = r;
+	switch_stack(&fs_main.esp, r->esp);
+	fs_cur = &fs_main;
+}
+
+/*****************************************************************************
+ *                                route_reply
+ *****************************************************************************/
+/**
+ * <Ring 1> If a message is a driver's completion of a request FS has in
+ * flight, put it where the request wants it. If a parked fs_req is waiting
+ * for it, make the fs_req ready.
+ * 
+ * @param m  The message.
+ * 
+ * @return Nonzero if it is such a completion.
+ *****************************************************************************/
+PRIVATE int route_reply(MESSAGE * m)
+{
+	struct fs_req * r;
+	int i;
+
+	for (i = 0; i < NR_DRV_INFLIGHT; i++)
+		if (fs_inflight[i].msg && fs_inflight[i].msg == m->TAG &&
+		    fs_inflight[i].drv == m->source)
 			break;
-		case RESUME_PROC:
+	if (i == NR_DRV_INFLIGHT)
+		return 0;
+
+	MESSAGE * dst = fs_inflight[i].msg;
+	fs_inflight[i].msg = 0;
+	fs_nr_inflight--;
+
+	*dst = *m;
+	dst->TAG = 0;		/* done, @see fs_drv_wait() */
+
+	for (r = fs_reqs; r < fs_reqs + NR_FS_REQS; r++) {
+		if (r->state == REQ_PARKED && r->drv_msg == dst) {
+			r->state = REQ_READY;
 			break;
-		default:
-			assert(0);
 		}
-#endif
+	}
+
+	return 1;
+}
+
+/*****************************************************************************
+ *                                fs_may_park
+ *****************************************************************************/
+/**
+ * <Ring 1> Let the current request be parked on block drivers, or not.
+ *
+ * Only the file data transfer of do_rdwt() allows it, which touches nothing
+ * other requests may change meanwhile. And not inside a batch, whose
+ * writes should not wait for a long transfer.
+ * 
+ * @param on  Nonzero to allow.
+ *****************************************************************************/
+PUBLIC void fs_may_park(int on)
+{
+	fs_cur->may_park = on && fs_cur != &fs_main && !batch_depth;
+}
+
+/*****************************************************************************
+ *                                fs_lock_inode
+ *****************************************************************************/
+/**
+ * <Ring 1> Lock an inode for a R/W, so that no other request reads or
+ * writes the file while the current one is parked in the middle of it.
+ * If another request has it locked, wait until it is unlocked.
+ *
+ * Only an fs_req outside a batch can wait. The others are never served
+ * while a lock is held, but for ring requests, which do_ring_enter()
+ * serves in a batch, so ring_op() refuses those on a locked inode.
+ * 
+ * @param pin  The inode.
+ *****************************************************************************/
+PUBLIC void fs_lock_inode(struct inode * pin)
+{
+	while (pin->i_busy) {
+		assert(fs_cur != &fs_main && !batch_depth);
+		fs_cur->state = REQ_WAITING;
+		fs_cur->wait_inode = pin;
+		switch_stack(&fs_cur->esp, fs_main.esp);
+	}
 
-		/* reply */
-		if (fs_msg.type != SUSPEND_PROC) {
-			fs_msg.type = SYSCALL_RET;
-			send_recv(SEND, src, &fs_msg);
+	pin->i_busy = 1;
+}
+
+/*****************************************************************************
+ *                                fs_unlock_inode
+ *****************************************************************************/
+/**
+ * <Ring 1> Unlock an inode fs_lock_inode() has locked, and let those
+ * waiting for it try again.
+ * 
+ * @param pin  The inode.
+ *****************************************************************************/
+PUBLIC void fs_unlock_inode(struct inode * pin)
+{
+	struct fs_req * r;
+
+	assert(pin->i_busy);
+	pin->i_busy = 0;
+
+	for (r = fs_reqs; r < fs_reqs + NR_FS_REQS; r++) {
+		if (r->state == REQ_WAITING && r->wait_inode == pin) {
+			r->state = REQ_READY;
+			r->wait_inode = 0;
 		}
 	}
 }
 
+/*****************************************************************************
+ *                                fs_chr_call
+ *****************************************************************************/
+/**
+ * <Ring 1> Send a request to a character driver and get the reply.
+ *
+ * The driver, i.e. TTY, sends RESUME_PROC async for the readers on other
+ * consoles, and one may be in FS's mailbox before the reply, so the receive
+ * half of the BOTH gets it instead. It is kept for task_fs() to serve, and
+ * FS goes on receiving until the reply comes.
+ *
+ * @param drv  The driver.
+ * @param m    The request, and the reply.
+ *****************************************************************************/
+PUBLIC void fs_chr_call(int drv, MESSAGE * m)
+{
+	send_recv(BOTH, drv, m);
+
+	while (m->type == RESUME_PROC) {
+		assert(fs_nr_resumes < NR_CONSOLES); /* a reader a console */
+		fs_resumes[fs_nr_resumes++] = *m;
+		send_recv(RECEIVE, drv, m);
+	}
+}
+
+/*****************************************************************************
+ *                                fs_drv_call
+ *****************************************************************************/
+/**
+ * <Ring 1> Send a request to a block driver and get the reply.
+ *
+ * If nothing is in flight, it is a plain BOTH. Otherwise the driver may be
+ * about to send a completion to FS, and FS must not block in SEND to it,
+ * so the request goes by fs_drv_submit() and fs_drv_wait().
+ *
+ * @param drv  The driver.
+ * @param m    The request, and the reply.
+ *****************************************************************************/
+PUBLIC void fs_drv_call(int drv, MESSAGE * m)
+{
+	if (fs_nr_inflight == 0 && !fs_cur->may_park) {
+		send_recv(BOTH, drv, m);
+		return;
+	}
+
+	fs_drv_submit(drv, m);
+	fs_drv_wait(drv, m);
+}
+
+/*****************************************************************************
+ *                                fs_drv_submit
+ *****************************************************************************/
+/**
+ * <Ring 1> Send a DEV_READ or DEV_WRITE to a block driver without waiting
+ * for it to be done.
+ *
+ * The request goes async with its own address as TAG, the driver queues
+ * it and sends the request back, TAG and all, as the completion when the
+ * disk is done. The driver's mailbox taking it is the ack.
+ *
+ * Neither send can block: a mailbox keeps MB_IO_SLOTS for DEV_READ and
+ * DEV_WRITE, which no other msg, e.g. a TTY reply or a ring doorbell, can
+ * take, @see msg_send_async(). FS has no more than NR_DRV_INFLIGHT, i.e.
+ * MB_IO_SLOTS, requests out, so there is always room for them in the
+ * driver's mailbox, and for their completions in FS's.
+ *
+ * @param drv  The driver.
+ * @param m    The request. It must stay until fs_drv_wait() on it.
+ *****************************************************************************/
+PUBLIC void fs_drv_submit(int drv, MESSAGE * m)
+{
+	fs_drv_track(drv, m);
+	send_async(drv, m);
+}
+
+/*****************************************************************************
+ *                                fs_drv_submit_vec
+ *****************************************************************************/
+/**
+ * <Ring 1> Send several requests as fs_drv_submit() does, as many at a time
+ * as there are free in-flight slots for, each lot in one send_async_vec().
+ *
+ * @param n      How many requests.
+ * @param dests  The drivers.
+ * @param msgs   The requests. They must stay until fs_drv_wait() on them.
+ *****************************************************************************/
+PRIVATE void fs_drv_submit_vec(int n, int * dests, MESSAGE * msgs)
+{
+	int i = 0;
+
+	while (i < n) {
+		int k;
+
+		fs_drv_track(dests[i], &msgs[i]);	/* waits for a slot */
+		for (k = 1; i + k < n && fs_nr_inflight < NR_DRV_INFLIGHT; k++)
+			fs_drv_track(dests[i + k], &msgs[i + k]);
+
+		send_async_vec(k, dests + i, msgs + i);
+		i += k;
+	}
+}
+
+/*****************************************************************************
+ *                                fs_drv_track
+ *****************************************************************************/
+/**
+ * <Ring 1> Put a request about to be sent into the in-flight table and tag
+ * it, waiting for a completion first if the table is full.
+ *
+ * @param drv  The driver.
+ * @param m    The request.
+ *****************************************************************************/
+PRIVATE void fs_drv_track(int drv, MESSAGE * m)
+{
+	int i;
+
+	while (fs_nr_inflight == NR_DRV_INFLIGHT) {
+		MESSAGE reply;
+		send_recv(RECEIVE, drv, &reply);
+		int routed = route_reply(&reply);
+		assert(routed);
+	}
+
+	for (i = 0; i < NR_DRV_INFLIGHT; i++)
+		if (!fs_inflight[i].msg)
+			break;
+	fs_inflight[i].msg = m;
+	fs_inflight[i].drv = drv;
+	fs_nr_inflight++;
+
+	m->TAG = m;
+}
+
+/*****************************************************************************
+ *                                fs_drv_wait
+ *****************************************************************************/
+/**
+ * <Ring 1> Wait for the completion of a request fs_drv_submit() has sent.
+ *
+ * If the current fs_req may be parked, it is, and FS serves others until
+ * the completion comes. Otherwise FS waits right here, routing the other
+ * completions to whom they belong.
+ *
+ * @param drv  The driver.
+ * @param m    The request, and the reply.
+ *****************************************************************************/
+PUBLIC void fs_drv_wait(int drv, MESSAGE * m)
+{
+	if (m->TAG != m)	/* done already */
+		return;
+
+	if (fs_cur->may_park) {
+		fs_cur->state = REQ_PARKED;
+		fs_cur->drv = drv;
+		fs_cur->drv_msg = m;
+		switch_stack(&fs_cur->esp, fs_main.esp);
+		return;		/* route_reply() has put the reply in m */
+	}
+
+	while (m->TAG == m) {
+		MESSAGE reply;
+		send_recv(RECEIVE, drv, &reply);
+		int routed = route_reply(&reply);
+		assert(routed);
+	}
+}
+
 /*****************************************************************************
  *                                init_fs
  *****************************************************************************/
@@ -148,6 +605,9 @@ PRIVATE void init_fs()
 	for (; sb < &super_block[NR_SUPER_BLOCK]; sb++)
 		sb->sb_dev = NO_DEV;
 
+	/* request rings */
+	init_ring();
+
 	/* open the device: hard disk */
 	MESSAGE driver_msg;
 	driver_msg.type = DEV_OPEN;
@@ -204,7 +664,7 @@ PRIVATE void mkfs()
 	assert(dd_map[MAJOR(ROOT_DEV)].driver_nr != INVALID_DRIVER);
 	send_recv(BOTH, dd_map[MAJOR(ROOT_DEV)].driver_nr, &driver_msg);
 
-	printl("{FS} dev size: 0x%x sectors\n", geo.size);
+	printl("{FS} dev size: 0x%x sectors\n", (u32)geo.size);
 
 	int bits_per_sect = SECTOR_SIZE * 8; /* 8 bits per byte */
 	/* generate a super block */
@@ -235,12 +695,12 @@ PRIVATE void mkfs()
 
 	printl("{FS} devbase:0x%x00, sb:0x%x00, imap:0x%x00, smap:0x%x00\n"
 	       "        inodes:0x%x00, 1st_sector:0x%x00\n", 
-	       geo.base * 2,
-	       (geo.base + 1) * 2,
-	       (geo.base + 1 + 1) * 2,
-	       (geo.base + 1 + 1 + sb.nr_imap_sects) * 2,
-	       (geo.base + 1 + 1 + sb.nr_imap_sects + sb.nr_smap_sects) * 2,
-	       (geo.base + sb.n_1st_sect) * 2);
+	       (u32)geo.base * 2,
+	       ((u32)geo.base + 1) * 2,
+	       ((u32)geo.base + 1 + 1) * 2,
+	       ((u32)geo.base + 1 + 1 + sb.nr_imap_sects) * 2,
+	       ((u32)geo.base + 1 + 1 + sb.nr_imap_sects + sb.nr_smap_sects) * 2,
+	       ((u32)geo.base + sb.n_1st_sect) * 2);
 
 	/************************/
 	/*       inode map      */
@@ -371,7 +831,7 @@ PRIVATE void mkfs()
  * @param proc_nr  To whom the buffer belongs.
  * @param buf      r/w buffer.
  * 
- * @return Zero if success.
+ * @return Zero if success, nonzero if the driver has failed.
  *****************************************************************************/
 PUBLIC int rw_sector(int io_type, int dev, u64 pos, int bytes, int proc_nr,
 		     void* buf)
@@ -384,12 +844,190 @@ PUBLIC int rw_sector(int io_type, int dev, u64 pos, int bytes, int proc_nr,
 	driver_msg.BUF		= buf;
 	driver_msg.CNT		= bytes;
 	driver_msg.PROC_NR	= proc_nr;
+	driver_msg.GRANT	= NO_GRANT;
 	assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
-	send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &driver_msg);
+	fs_drv_call(dd_map[MAJOR(dev)].driver_nr, &driver_msg);
+
+	return driver_msg.CNT != bytes;
+}
+
+/*****************************************************************************
+ *                                rw_sector_grant
+ *****************************************************************************/
+/**
+ * <Ring 1> R/W sectors via messaging with the corresponding driver, which
+ * transfers the data from/to a granted window directly.
+ * 
+ * @param io_type  DEV_READ or DEV_WRITE
+ * @param dev      device nr
+ * @param pos      Byte offset from/to where to r/w.
+ * @param bytes    r/w count in bytes.
+ * @param granter  To whom the window belongs.
+ * @param gid      The grant, which must have been handed on to the driver.
+ * @param off      Offset in the window.
+ * 
+ * @return Zero if success, nonzero if the driver has failed.
+ *****************************************************************************/
+PUBLIC int rw_sector_grant(int io_type, int dev, u64 pos, int bytes,
+			   int granter, int gid, int off)
+{
+	MESSAGE driver_msg;
+
+	driver_msg.type		= io_type;
+	driver_msg.DEVICE	= MINOR(dev);
+	driver_msg.POSITION	= pos;
+	driver_msg.BUF		= (void*)off;
+	driver_msg.CNT		= bytes;
+	driver_msg.PROC_NR	= granter;
+	driver_msg.GRANT	= gid;
+	assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
+	fs_drv_call(dd_map[MAJOR(dev)].driver_nr, &driver_msg);
+
+	return driver_msg.CNT != bytes;
+}
+
+
+/*****************************************************************************
+ *                                rd_sect
+ *****************************************************************************/
+/**
+ * <Ring 1> Read a sector into fsbuf. If a write to the sector is being held
+ * back, it is newer than the disk, so it is copied instead.
+ * 
+ * @param dev      device nr
+ * @param sect_nr  Which sector.
+ * 
+ * @return Zero if success, nonzero if the driver has failed.
+ *****************************************************************************/
+PUBLIC int rd_sect(int dev, int sect_nr)
+{
+	int i;
+	for (i = 0; i < batch_cnt; i++) {
+		if (batch[i].dev == dev && batch[i].sect_nr == sect_nr) {
+			memcpy(fsbuf, batch[i].buf, SECTOR_SIZE);
+			return 0;
+		}
+	}
+
+	return rw_sector(DEV_READ, dev, (u64)sect_nr * SECTOR_SIZE,
+			 SECTOR_SIZE, TASK_FS, fsbuf);
+}
 
+/*****************************************************************************
+ *                                wr_sect
+ *****************************************************************************/
+/**
+ * <Ring 1> Write the first sector of fsbuf to the disk. Inside a batch the
+ * sector is only copied aside, and a later write to the same sector replaces
+ * it, @see end_batch().
+ * 
+ * @param dev      device nr
+ * @param sect_nr  Which sector.
+ * 
+ * @return Zero if success, nonzero if the driver has failed. Inside a
+ *         batch, a failure is told by end_batch().
+ *****************************************************************************/
+PUBLIC int wr_sect(int dev, int sect_nr)
+{
+	if (!batch_depth)
+		return rw_sector(DEV_WRITE, dev, (u64)sect_nr * SECTOR_SIZE,
+				 SECTOR_SIZE, TASK_FS, fsbuf);
+
+	int i;
+	for (i = 0; i < batch_cnt; i++)
+		if (batch[i].dev == dev && batch[i].sect_nr == sect_nr)
+			break;
+
+	if (i == batch_cnt) {
+		if (batch_cnt == NR_BATCH_SECTS)
+			batch_err |= flush_batch();
+		i = batch_cnt++;
+		batch[i].dev = dev;
+		batch[i].sect_nr = sect_nr;
+	}
+
+	memcpy(batch[i].buf, fsbuf, SECTOR_SIZE);
 	return 0;
 }
 
+/*****************************************************************************
+ *                                begin_batch
+ *****************************************************************************/
+/**
+ * <Ring 1> Hold back WR_SECT's until end_batch(), so that a metadata update
+ * which touches several sectors sends them to the driver all at once.
+ * Batches may nest, the outermost end_batch() does the writing.
+ *****************************************************************************/
+PUBLIC void begin_batch()
+{
+	batch_depth++;
+}
+
+/*****************************************************************************
+ *                                end_batch
+ *****************************************************************************/
+/**
+ * <Ring 1> Write the sectors held back since begin_batch().
+ * 
+ * @return Zero if success, nonzero if any write of the outermost batch has
+ *         failed. An inner end_batch() writes nothing and returns zero.
+ *****************************************************************************/
+PUBLIC int end_batch()
+{
+	assert(batch_depth > 0);
+	if (--batch_depth)
+		return 0;
+
+	int err = batch_err | flush_batch();
+	batch_err = 0;
+	return err;
+}
+
+/*****************************************************************************
+ *                                flush_batch
+ *****************************************************************************/
+/**
+ * <Ring 1> Send all the held back sector writes to their drivers, and wait
+ * until they are all done. They are all submitted, in as few traps as the
+ * in-flight slots allow, before the first one is waited for, so the driver
+ * may merge the neighbouring ones.
+ * 
+ * @return Zero if success, nonzero if any of them has failed.
+ *****************************************************************************/
+PRIVATE int flush_batch()
+{
+	MESSAGE msgs[NR_BATCH_SECTS];
+	int dests[NR_BATCH_SECTS];
+	int err = 0;
+	int i;
+
+	if (!batch_cnt)
+		return 0;
+
+	for (i = 0; i < batch_cnt; i++) {
+		int dev = batch[i].dev;
+
+		msgs[i].type		= DEV_WRITE;
+		msgs[i].DEVICE		= MINOR(dev);
+		msgs[i].POSITION	= (u64)batch[i].sect_nr * SECTOR_SIZE;
+		msgs[i].BUF		= batch[i].buf;
+		msgs[i].CNT		= SECTOR_SIZE;
+		msgs[i].PROC_NR		= TASK_FS;
+		msgs[i].GRANT		= NO_GRANT;
+		dests[i] = dd_map[MAJOR(dev)].driver_nr;
+		assert(dests[i] != INVALID_DRIVER);
+	}
+
+	fs_drv_submit_vec(batch_cnt, dests, msgs);
+	for (i = 0; i < batch_cnt; i++) {
+		fs_drv_wait(dests[i], &msgs[i]);
+		if (msgs[i].CNT != SECTOR_SIZE)
+			err = 1;
+	}
+
+	batch_cnt = 0;
+	return err;
+}
 
 /*****************************************************************************
  *                                read_super_block
@@ -411,8 +1049,9 @@ PRIVATE void read_super_block(int dev)
 	driver_msg.BUF		= fsbuf;
 	driver_msg.CNT		= SECTOR_SIZE;
 	driver_msg.PROC_NR	= TASK_FS;
+	driver_msg.GRANT	= NO_GRANT;
 	assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
-	send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &driver_msg);
+	fs_drv_call(dd_map[MAJOR(dev)].driver_nr, &driver_msg);
 
 	/* find a free slot in super_block[] */
 	for (i = 0; i < NR_SUPER_BLOCK; i++)
@@ -493,6 +1132,7 @@ PUBLIC struct inode * get_inode(int dev, int num)
 	q->i_dev = dev;
 	q->i_num = num;
 	q->i_cnt = 1;
+	q->i_busy = 0;
 
 	struct super_block * sb = get_super_block(dev);
 	int blk_nr = 1 + 1 + sb->nr_imap_sects + sb->nr_smap_sects +
@@ -596,6 +1236,7 @@ PRIVATE int fs_exit()
 			p->filp[i] = 0;
 		}
 	}
+	ring_exit(fs_msg.PID);
 	return 0;
 }
 
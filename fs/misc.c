@@ -119,7 +119,8 @@ PUBLIC int search_file(char * path)
 	int m = 0;
 	struct dir_entry * pde;
 	for (i = 0; i < nr_dir_blks; i++) {
-		RD_SECT(dir_inode->i_dev, dir_blk0_nr + i);
+		if (RD_SECT(dir_inode->i_dev, dir_blk0_nr + i) != 0)
+			return 0;	/* taken as not found */
 		pde = (struct dir_entry *)fsbuf;
 		for (j = 0; j < SECTOR_SIZE / DIR_ENTRY_SIZE; j++,pde++) {
 			if (memcmp(filename, pde->name, MAX_FILENAME_LEN) == 0)
@@ -132,9 +132,8 @@ PUBLIC int do_open()
 			driver_msg.DEVICE = MINOR(dev);
 			assert(MAJOR(dev) == 4);
 			assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
-			send_recv(BOTH,
-				  dd_map[MAJOR(dev)].driver_nr,
-				  &driver_msg);
+			fs_chr_call(dd_map[MAJOR(dev)].driver_nr,
+				    &driver_msg);
 		}
 		else if (imode == I_DIRECTORY) {
 			assert(pin->i_num == ROOT_INODE);
@@ -171,6 +170,9 @@ PRIVATE struct inode * create_file(char * path, int flags)
 	if (strip_path(filename, path, &dir_inode) != 0)
 		return 0;
 
+	/* imap, smap, i-node and dir sectors go to the driver at once */
+	begin_batch();
+
 	int inode_nr = alloc_imap_bit(dir_inode->i_dev);
 	int free_sect_nr = alloc_smap_bit(dir_inode->i_dev,
 					  NR_DEFAULT_FILE_SECTS);
@@ -179,6 +181,12 @@ PRIVATE struct inode * create_file(char * path, int flags)
 
 	new_dir_entry(dir_inode, newino->i_num, filename);
 
+	if (end_batch() != 0) {
+		printl("{FS} cannot write the new file to disk: %s\n", path);
+		put_inode(newino);
+		return 0;
+	}
+
 	return newino;
 }
 
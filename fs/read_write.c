@@ -29,8 +29,13 @@
  *
  * Sector map is not needed to update, since the sectors for the file have been
  * allocated and the bits are set when the file was created.
+ *
+ * If the caller has granted FS its buffer, whole sectors are transferred
+ * between the disk and the buffer by the driver directly, and only a partial
+ * sector at either end goes through fsbuf.
  * 
- * @return How many bytes have been read/written.
+ * @return How many bytes have been read/written. If the driver fails, those
+ *         done before, or -1 if none.
  *****************************************************************************/
 PUBLIC int do_rdwt()
 {
@@ -65,8 +70,31 @@ PUBLIC int do_rdwt()
 		fs_msg.BUF	= buf;
 		fs_msg.CNT	= len;
 		fs_msg.PROC_NR	= src;
-		assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
-		send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &fs_msg);
+		int drv = dd_map[MAJOR(dev)].driver_nr;
+		assert(drv != INVALID_DRIVER);
+
+		/**
+		 * A write is handed off: TTY replies to the caller itself
+		 * when all the chars are out, and FS goes on at once, telling
+		 * the caller whom to wait for (no more reply from FS, as a
+		 * SUSPEND_PROC read gets). @see write()
+		 *
+		 * Only FS sends async msgs to TTY, so if its mailbox has
+		 * room for a DEV_WRITE now, it will when the msg goes. If it
+		 * has not, the write is done the old way.
+		 */
+		if (t == DEV_WRITE && proc_table[drv].mb_io_cnt < MB_IO_SLOTS) {
+			fs_msg.FLAGS = DEV_REPLY_PROC;
+			send_async(drv, &fs_msg);
+
+			fs_msg.type = SUSPEND_PROC;
+			fs_msg.PROC_NR = drv;
+			send_async(src, &fs_msg);
+			return len;
+		}
+
+		fs_msg.FLAGS = 0;
+		fs_chr_call(drv, &fs_msg);
 		assert(fs_msg.CNT == len);
 
 		return fs_msg.CNT;
@@ -86,36 +114,100 @@ PUBLIC int do_rdwt()
 		int rw_sect_max=pin->i_start_sect+(pos_end>>SECTOR_SIZE_SHIFT);
 
 		int chunk = min(rw_sect_max - rw_sect_min + 1,
-				FSBUF_SIZE >> SECTOR_SIZE_SHIFT);
+				fsbuf_size >> SECTOR_SIZE_SHIFT);
+
+		/* hand the caller's grant on to the driver, if it's good */
+		int gid = fs_msg.GRANT;
+		int rights = fs_msg.type == READ ? GRANT_WRITE : GRANT_READ;
+		if (gid != NO_GRANT &&
+		    (!grant_la(src, gid, TASK_FS, 0, len, rights) ||
+		     grant_fwd(src, gid, TASK_FS,
+				dd_map[MAJOR(pin->i_dev)].driver_nr) != 0))
+			gid = NO_GRANT;
+
+		/**
+		 * Other requests may be served while the data are moving,
+		 * unless the file desc is shared, whose fd_pos they may use.
+		 * Those on the same inode wait for the lock.
+		 */
+		fs_lock_inode(pin);
+		fs_may_park(pcaller->filp[fd]->fd_cnt == 1);
 
 		int bytes_rw = 0;
 		int bytes_left = len;
+		int err = 0;	/* the driver has failed, stop there */
 		int i;
 		for (i = rw_sect_min; i <= rw_sect_max; i += chunk) {
 			/* read/write this amount of bytes every time */
 			int bytes = min(bytes_left, chunk * SECTOR_SIZE - off);
-			rw_sector(DEV_READ,
-				  pin->i_dev,
-				  i * SECTOR_SIZE,
-				  chunk * SECTOR_SIZE,
-				  TASK_FS,
-				  fsbuf);
-
-			if (fs_msg.type == READ) {
-				phys_copy((void*)va2la(src, buf + bytes_rw),
+
+			/* whole sectors need no bounce */
+			int direct = (gid != NO_GRANT && off == 0) ?
+				bytes & ~(SECTOR_SIZE - 1) : 0;
+			if (direct)
+				err = rw_sector_grant(fs_msg.type == READ ?
+						      DEV_READ : DEV_WRITE,
+						      pin->i_dev,
+						      i * SECTOR_SIZE,
+						      direct,
+						      src, gid, bytes_rw);
+			if (err)
+				break;
+
+			/* the rest goes through fsbuf, only the sectors it covers */
+			int rest_sect = i + (direct >> SECTOR_SIZE_SHIFT);
+			int rest_end = off + bytes - direct; /* in fsbuf */
+			int rest_size = (rest_end + SECTOR_SIZE - 1) &
+					~(SECTOR_SIZE - 1);
+			if (bytes > direct && fs_msg.type == READ)
+				err = rw_sector(DEV_READ,
+						pin->i_dev,
+						rest_sect * SECTOR_SIZE,
+						rest_size,
+						TASK_FS,
+						fsbuf);
+			else if (bytes > direct) {
+				/* only partial sectors need the old data */
+				if (off)
+					err = rw_sector(DEV_READ,
+							pin->i_dev,
+							rest_sect * SECTOR_SIZE,
+							SECTOR_SIZE,
+							TASK_FS,
+							fsbuf);
+				if (!err && (rest_end % SECTOR_SIZE) &&
+				    (!off || rest_size > SECTOR_SIZE))
+					err = rw_sector(DEV_READ,
+							pin->i_dev,
+							(rest_sect * SECTOR_SIZE +
+							 rest_size - SECTOR_SIZE),
+							SECTOR_SIZE,
+							TASK_FS,
+							fsbuf + rest_size - SECTOR_SIZE);
+			}
+			if (err)
+				break;
+
+			if (bytes == direct) {
+				/* done */
+			}
+			else if (fs_msg.type == READ) {
+				phys_copy((void*)va2la(src, buf + bytes_rw + direct),
 					  (void*)va2la(TASK_FS, fsbuf + off),
-					  bytes);
+					  bytes - direct);
 			}
 			else {	/* WRITE */
 				phys_copy((void*)va2la(TASK_FS, fsbuf + off),
-					  (void*)va2la(src, buf + bytes_rw),
-					  bytes);
-				rw_sector(DEV_WRITE,
-					  pin->i_dev,
-					  i * SECTOR_SIZE,
-					  chunk * SECTOR_SIZE,
-					  TASK_FS,
-					  fsbuf);
+					  (void*)va2la(src, buf + bytes_rw + direct),
+					  bytes - direct);
+				err = rw_sector(DEV_WRITE,
+						pin->i_dev,
+						rest_sect * SECTOR_SIZE,
+						rest_size,
+						TASK_FS,
+						fsbuf);
+				if (err)
+					break;
 			}
 			off = 0;
 			bytes_rw += bytes;
@@ -123,6 +215,8 @@ PUBLIC int do_rdwt()
 			bytes_left -= bytes;
 		}
 
+		fs_may_park(0);
+
 		if (pcaller->filp[fd]->fd_pos > pin->i_size) {
 			/* update inode::size */
 			pin->i_size = pcaller->filp[fd]->fd_pos;
@@ -130,6 +224,9 @@ PUBLIC int do_rdwt()
 			sync_inode(pin);
 		}
 
-		return bytes_rw;
+		fs_unlock_inode(pin);
+
+		/* what has been done before a failure counts */
+		return (err && !bytes_rw) ? -1 : bytes_rw;
 	}
 }
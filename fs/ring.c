@@ -0,0 +1,230 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   ring.c
+ * @brief  Request rings between user procs and FS.
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+
+/**
+ * A proc may register a struct fs_ring of its own with FS, granting FS the
+ * memory it lives in. It then pushes many requests into the ring and rings
+ * the doorbell (RING_ENTER) once, instead of trapping into a BOTH round trip
+ * for each of them. FS does the requests one after another, as if they were
+ * sent by the proc, and puts the results into the ring.
+ *
+ * Requests which FS cannot finish at once, i.e. those on a TTY or on a file
+ * another request is reading or writing, are refused.
+ */
+
+PRIVATE int ring_gid[NR_TASKS + NR_PROCS]; /* NO_GRANT if none is set up */
+
+PRIVATE struct fs_ring * get_ring(int pid);
+PRIVATE int ring_op(int src, MESSAGE * m);
+
+/*****************************************************************************
+ *                                init_ring
+ *****************************************************************************/
+/**
+ * Nobody has a ring at first.
+ *
+ *****************************************************************************/
+PUBLIC void init_ring()
+{
+	int i;
+	for (i = 0; i < NR_TASKS + NR_PROCS; i++)
+		ring_gid[i] = NO_GRANT;
+}
+
+/*****************************************************************************
+ *                                do_ring_setup
+ *****************************************************************************/
+/**
+ * Perform the ring_setup() and ring_release() syscalls.
+ *
+ * The caller grants FS its ring, and fs_msg.GRANT is the gid. NO_GRANT
+ * takes the ring away, and the old gid is returned in fs_msg.GRANT so that
+ * the caller can revoke it.
+ *
+ * @return Zero if success.
+ *****************************************************************************/
+PUBLIC int do_ring_setup()
+{
+	int src = fs_msg.source;
+	int gid = fs_msg.GRANT;
+
+	if (gid == NO_GRANT) {
+		fs_msg.GRANT = ring_gid[src];
+		ring_gid[src] = NO_GRANT;
+		return 0;
+	}
+
+	if (ring_gid[src] != NO_GRANT)
+		return -1;
+
+	ring_gid[src] = gid;
+	if (!get_ring(src)) {
+		ring_gid[src] = NO_GRANT;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                do_ring_enter
+ *****************************************************************************/
+/**
+ * Perform the ring_enter() syscall: do the requests in the caller's ring
+ * until it is empty or there is no room for more results. The metadata
+ * writes of all of them go to the disk in one batch.
+ *
+ * @return How many results are waiting to be reaped, -1 if there is no ring,
+ *         its indices are wrong, or the metadata writes have failed.
+ *****************************************************************************/
+PUBLIC int do_ring_enter()
+{
+	int src = fs_msg.source;
+	struct fs_ring * r = get_ring(src);
+
+	if (!r)
+		return -1;
+
+	/**
+	 * The proc may go on running and changing the ring while FS is at
+	 * it, so the indices are read once, and what it has put there must
+	 * make sense. No more than NR_RING_ENTRIES requests are done a time.
+	 */
+	u32 sq_head = r->sq_head;
+	u32 sq_tail = r->sq_tail;
+	u32 cq_head = r->cq_head;
+	u32 cq_tail = r->cq_tail;
+	if (sq_tail - sq_head > NR_RING_ENTRIES ||
+	    cq_tail - cq_head > NR_RING_ENTRIES)
+		return -1;
+
+	MESSAGE bell = fs_msg;	/* the ring ops use fs_msg */
+
+	begin_batch();
+	while (sq_head != sq_tail && cq_tail - cq_head < NR_RING_ENTRIES) {
+		struct fs_sqe * sqe = &r->sq[sq_head % NR_RING_ENTRIES];
+		struct fs_cqe * cqe = &r->cq[cq_tail % NR_RING_ENTRIES];
+
+		cqe->user_data = sqe->user_data;
+		cqe->res = ring_op(src, &sqe->msg);
+
+		r->sq_head = ++sq_head;
+		r->cq_tail = ++cq_tail;
+	}
+	int err = end_batch();
+
+	fs_msg = bell;
+	pcaller = &proc_table[src];
+
+	return err ? -1 : cq_tail - cq_head;
+}
+
+/*****************************************************************************
+ *                                ring_exit
+ *****************************************************************************/
+/**
+ * Forget the ring of a proc which is exiting.
+ *
+ * @param pid  The proc.
+ *****************************************************************************/
+PUBLIC void ring_exit(int pid)
+{
+	ring_gid[pid] = NO_GRANT;
+}
+
+/*****************************************************************************
+ *                                get_ring
+ *****************************************************************************/
+/**
+ * Find the ring of a proc. The grant is checked each time, since the proc
+ * may have revoked it.
+ *
+ * @param pid  The proc.
+ *
+ * @return Ptr to the ring, 0 if there is none.
+ *****************************************************************************/
+PRIVATE struct fs_ring * get_ring(int pid)
+{
+	if (ring_gid[pid] == NO_GRANT)
+		return 0;
+
+	/* la == va for FS, @see va2la() */
+	return (struct fs_ring *)grant_la(pid, ring_gid[pid], TASK_FS, 0,
+					  sizeof(struct fs_ring),
+					  GRANT_READ | GRANT_WRITE);
+}
+
+/*****************************************************************************
+ *                                ring_op
+ *****************************************************************************/
+/**
+ * Do one request from a ring.
+ *
+ * @param src  Whose request.
+ * @param m    The request.
+ *
+ * @return What the syscall would return, -1 if the request is refused.
+ *****************************************************************************/
+PRIVATE int ring_op(int src, MESSAGE * m)
+{
+	fs_msg = *m;
+	fs_msg.source = src;
+	pcaller = &proc_table[src];
+
+	/* the ring's own grant is no buffer */
+	if (fs_msg.GRANT == ring_gid[src])
+		fs_msg.GRANT = NO_GRANT;
+
+	int fd = fs_msg.FD;
+	switch (fs_msg.type) {
+	case CLOSE:
+	case READ:
+	case WRITE:
+	case LSEEK:
+		if (fd < 0 || fd >= NR_FILES || !pcaller->filp[fd])
+			return -1;
+		if ((pcaller->filp[fd]->fd_inode->i_mode & I_TYPE_MASK) ==
+		    I_CHAR_SPECIAL && fs_msg.type != CLOSE)
+			return -1;
+		/* a parked R/W holds it, @see fs_lock_inode() */
+		if (pcaller->filp[fd]->fd_inode->i_busy &&
+		    (fs_msg.type == READ || fs_msg.type == WRITE))
+			return -1;
+		break;
+	}
+
+	switch (fs_msg.type) {
+	case OPEN:
+		return do_open();
+	case CLOSE:
+		return do_close();
+	case READ:
+	case WRITE:
+		return do_rdwt();
+	case LSEEK:
+		return do_lseek();
+	case STAT:
+		return do_stat();
+	default:
+		return -1;
+	}
+}
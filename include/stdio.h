@@ -63,6 +63,95 @@ struct time {
 	u32 second;
 };
 
+/**
+ * @struct kinfo
+ * @brief  Kernel info page. Every proc has a read-only copy of its own,
+ *         which can be read through %fs, @see lib/kinfo.c
+ */
+struct kinfo {
+	u32		seq;	/* changes each time the page is updated */
+	int		pid;	/* of the proc the page belongs to */
+	int		ticks;
+	u64		tsc;	/* TSC at the latest clock tick */
+
+	/* ns = (TSC - boot_tsc) * tsc_mult >> tsc_shift, @see clock_ns() */
+	u64		boot_tsc;
+	u32		tsc_mult;
+	int		tsc_shift;
+
+	u32		rtc_sec; /* wall clock read from the RTC at boot, */
+	u64		rtc_ns;	 /* and clock_ns() when it was read */
+};
+
+/**
+ * @struct timeval
+ * @brief  Wall clock, returned by gettimeofday().
+ */
+struct timeval {
+	u32 tv_sec;	/* seconds since 1970-01-01 00:00:00 */
+	u32 tv_usec;
+};
+
+/**
+ * @struct proc_stat
+ * @brief  Per-proc accounting, returned by syscall getpstat();
+ */
+struct proc_stat {
+	char	name[16];	/* name of the proc */
+	int	p_flags;	/* zero if runnable, FREE_SLOT if unused */
+	int	prio;		/* current (dynamic) priority */
+	int	user_ticks;	/* ticks spent outside the kernel */
+	int	sys_ticks;	/* ticks spent in the kernel */
+	int	nr_vol_sw;	/* switched out because it blocked */
+	int	nr_invol_sw;	/* switched out because it was preempted */
+	int	nr_sent;	/* messages sent */
+	int	nr_recv;	/* messages received */
+	int	send_ticks;	/* ticks blocked in SENDING */
+	int	recv_ticks;	/* ticks blocked in RECEIVING */
+};
+
+/**
+ * @struct fs_ring
+ * @brief  Requests to FS and their results, in the memory of a proc which
+ *         registered it by ring_setup(). The proc pushes MESSAGEs as
+ *         open()/read()/... would send them, FS completes them on
+ *         ring_enter(). @see fs/ring.c
+ */
+#define	NR_RING_ENTRIES	16
+struct fs_sqe {
+	u32	user_data;	/* handed back in the completion */
+	MESSAGE	msg;		/* OPEN, CLOSE, READ, WRITE, LSEEK or STAT */
+};
+struct fs_cqe {
+	u32	user_data;
+	int	res;		/* what the syscall would return */
+};
+struct fs_ring {
+	u32		sq_head;	/* FS takes the next request here */
+	u32		sq_tail;	/* the proc puts the next request here */
+	u32		cq_head;	/* the proc reaps the next result here */
+	u32		cq_tail;	/* FS puts the next result here */
+	struct fs_sqe	sq[NR_RING_ENTRIES];
+	struct fs_cqe	cq[NR_RING_ENTRIES];
+};
+
+/**
+ * @struct svc_stat
+ * @brief  Per-msg-type service time of a server (TASK FS, MM or HD),
+ *         returned by getsvcstat();
+ */
+#define	NR_SVC_BUCKETS	32
+struct svc_stat {
+	int	type;		/* msg type, 0 if the entry is unused */
+	int	cnt;		/* how many msgs have been served */
+	u64	total_ns;	/* from RECEIVE to the reply */
+	u32	min_ns;
+	u32	max_ns;
+	int	q_total;	/* msgs still waiting for the server at RECEIVE */
+	int	q_max;
+	int	hist[NR_SVC_BUCKETS]; /* hist[i]: service time in [2^i, 2^(i+1)) ns */
+};
+
 #define  BCD_TO_DEC(x)      ( (x >> 4) * 10 + (x & 0x0f) )
 
 /*========================*
@@ -147,6 +236,38 @@ PUBLIC int	execv		(const char * path, char * argv[]);
 /* lib/stat.c */
 PUBLIC int	stat		(const char *path, struct stat *buf);
 
+/* lib/sleep.c */
+PUBLIC int	sleep		(int seconds);
+PUBLIC int	usleep		(int usec);
+
+/* lib/kinfo.c */
+PUBLIC void	get_kinfo	(struct kinfo * k);
+PUBLIC int	get_ticks	();
+
+/* lib/time.c */
+PUBLIC u64	clock_ns	();
+PUBLIC int	gettimeofday	(struct timeval * tv);
+PUBLIC u32	time2sec	(struct time * t);
+PUBLIC void	sec2time	(u32 sec, struct time * t);
+PUBLIC u32	div64		(u64 * n, u32 d);
+
+/* lib/getpstat.c */
+PUBLIC int	getpstat	(struct proc_stat * buf, int nr);
+
+/* lib/ring.c */
+PUBLIC int	ring_setup	(struct fs_ring * r);
+PUBLIC int	ring_release	(struct fs_ring * r);
+PUBLIC int	ring_push	(struct fs_ring * r, u32 user_data, MESSAGE * m);
+PUBLIC int	ring_enter	(struct fs_ring * r, int wait);
+PUBLIC int	ring_reap	(struct fs_ring * r, struct fs_cqe * cqe);
+
+/* lib/svcstat.c */
+PUBLIC int	getsvcstat	(int server, struct svc_stat * buf, int nr);
+
+/* lib/trace.c */
+PUBLIC int	trace_ctl	(int req);
+PUBLIC int	trace_dump	();
+
 /* lib/syslog.c */
 PUBLIC	int	syslog		(const char *fmt, ...);
 
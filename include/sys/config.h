@@ -41,3 +41,10 @@
 #define SET_LOG_SECT_SMAP_AT_STARTUP
 #define MEMSET_LOG_SECTS
 #define	NR_SECTS_FOR_LOG		NR_DEFAULT_FILE_SECTS
+
+/*
+ * IPC trace: where in the log sectors the ring goes by TRACE_DUMP, a header
+ * sector followed by the records, @see fs/disklog.c::do_trace_dump()
+ */
+#define	TRACE_LOG_OFF			(NR_SECTS_FOR_LOG - 64)
+#define	TRACE_LOG_SECTS			(1 + NR_TRACE_RECS * 16 / SECTOR_SIZE)
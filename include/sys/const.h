@@ -64,6 +64,16 @@
 #define RATE_GENERATOR 0x34 /* 00-11-010-0 :
 			     * Counter0 - LSB then MSB - rate generator - binary
 			     */
+#define ONE_SHOT       0x30 /* 00-11-000-0 :
+			     * Counter0 - LSB then MSB - interrupt on terminal
+			     * count - binary
+			     */
+#define READ_BACK0     0xC2 /* 11-0-0-001-0 :
+			     * Read-back - latch count and status of Counter0
+			     */
+#define READ_STATUS0   0xE2 /* 11-1-0-001-0 :
+			     * Read-back - latch status of Counter0
+			     */
 #define TIMER_FREQ     1193182L/* clock frequency for timer in PC and AT */
 #define HZ             100  /* clock freq (software settable on IBM-PC) */
 
@@ -137,19 +147,60 @@
 #define TASK_HD		2
 #define TASK_FS		3
 #define TASK_MM		4
-#define INIT		5
+#define TASK_IDLE	5
+#define INIT		6
 #define ANY		(NR_TASKS + NR_PROCS + 10)
 #define NO_TASK		(NR_TASKS + NR_PROCS + 20)
 
 #define	MAX_TICKS	0x7FFFABCD
 
 /* system call */
-#define NR_SYS_CALL	3
+#define NR_SYS_CALL	7
 
 /* ipc */
 #define SEND		1
 #define RECEIVE		2
 #define BOTH		3	/* BOTH = (SEND | RECEIVE) */
+#define SEND_ASYNC	4	/* never blocks, @see msg_send_async() */
+#define RECEIVE_TIMED	5	/* RECEIVE, but wait msg->TIMEOUT ticks at most */
+
+/* async msgs a proc can hold before SEND_ASYNC to it fails */
+#define MAILBOX_SIZE	8
+#define MB_IO_SLOTS	4	/* of them, for DEV_READ and DEV_WRITE only */
+#define MAILBOX_FULL	1	/* returned by SEND_ASYNC */
+#define TIMED_OUT	2	/* returned by RECEIVE_TIMED */
+
+/* source, type and the first 4 words of u, @see sendrec_short() */
+#define SHORT_MSG_SIZE	(6 * sizeof(int))
+
+/* memory grants, @see kernel/grant.c */
+#define NR_GRANTS	4	/* grants a proc can have at a time */
+#define GRANT_READ	1	/* the grantee may read the window */
+#define GRANT_WRITE	2	/* the grantee may write the window */
+#define NO_GRANT	-1
+
+/* IPC trace, @see kernel/trace.c */
+#define NR_TRACE_RECS	1024	/* must be a power of 2 */
+#define TRACE_OFF	0	/* TRACE_CTL requests */
+#define TRACE_ON	1
+#define TRACE_CLEAR	2
+#define TRC_SEND	1	/* src is put into dst's sending queue */
+#define TRC_DELIVER	2	/* src's msg is copied to dst, who was waiting */
+#define TRC_ASYNC	3	/* src's msg is put into dst's mailbox */
+#define TRC_RECV	4	/* dst takes src's msg which was waiting */
+#define TRC_INT		5	/* an interrupt for dst */
+#define TRC_BLOCK	6	/* src blocks on dst, type is p_flags */
+#define TRC_UNBLOCK	7	/* src is runnable again */
+#define TRC_SCHED	8	/* src is switched out, dst in */
+
+/* RING_ENTER: reply when the requests are done, @see ring_enter() */
+#define RING_WAIT	1
+
+/* DEV_WRITE to TTY: reply to PROC_NR rather than FS, @see do_rdwt() */
+#define DEV_REPLY_PROC	1
+
+/* msg types a server keeps service times for, @see lib/svcstat.c */
+#define NR_SVC_TYPES	16
 
 /* magic chars used by `printx' */
 #define MAG_CH_PANIC	'\002'
@@ -166,12 +217,25 @@ enum msgtype {
 	 */
 	HARD_INT = 1,
 
+	/* RECEIVE_TIMED gets this if nothing comes in time */
+	RECV_TIMEOUT,
+
 	/* SYS task */
-	GET_TICKS, GET_PID, GET_RTC_TIME,
+	GET_TICKS, GET_PID, GET_RTC_TIME, GET_PROC_STAT, SLEEP_TICKS,
+	TRACE_CTL,
 
 	/* FS */
 	OPEN, CLOSE, READ, WRITE, LSEEK, STAT, UNLINK,
 
+	/* FS: write the IPC trace into the log sectors */
+	TRACE_DUMP,
+
+	/* FS: request rings, @see fs/ring.c */
+	RING_SETUP, RING_ENTER,
+
+	/* FS, MM & HD: get the service times */
+	SVC_STAT,
+
 	/* FS & TTY */
 	SUSPEND_PROC, RESUME_PROC,
 
@@ -204,12 +268,17 @@ enum msgtype {
 #define	DEVICE		u.m3.m3i4
 #define	POSITION	u.m3.m3l1
 #define	BUF		u.m3.m3p2
+#define	TAG		u.m3.m3p1	/* the driver echoes it, @see fs_drv_submit() */
 #define	OFFSET		u.m3.m3i2
 #define	WHENCE		u.m3.m3i3
 
 #define	PID		u.m3.m3i2
 #define	RETVAL		u.m3.m3i1
+#define	GRANT		u.m3.m3l2
 #define	STATUS		u.m3.m3i1
+#define	INT_IRQS	u.m3.m3i1	/* HARD_INT: bitmap of the IRQs */
+#define	INT_CNT		u.m3.m3i2	/* HARD_INT: how many interrupts */
+#define	TIMEOUT		u.m3.m3i1	/* RECEIVE_TIMED: in ticks */
 
 
 
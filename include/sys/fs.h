@@ -83,6 +83,7 @@ struct inode {
 	int	i_dev;
 	int	i_cnt;		/**< How many procs share this inode  */
 	int	i_num;		/**< inode nr.  */
+	int	i_busy;		/**< Locked by a R/W, @see fs_lock_inode() */
 };
 
 /**
@@ -133,19 +134,43 @@ struct file_desc {
 /**
  * Since all invocations of `rw_sector()' in FS look similar (most of the
  * params are the same), we use this macro to make code more readable.
+ * Both go through fsbuf, and WR_SECT is held back between begin_batch()
+ * and end_batch(), @see fs/main.c
  */
-#define RD_SECT(dev,sect_nr) rw_sector(DEV_READ, \
-				       dev,				\
-				       (sect_nr) * SECTOR_SIZE,		\
-				       SECTOR_SIZE, /* read one sector */ \
-				       TASK_FS,				\
-				       fsbuf);
-#define WR_SECT(dev,sect_nr) rw_sector(DEV_WRITE, \
-				       dev,				\
-				       (sect_nr) * SECTOR_SIZE,		\
-				       SECTOR_SIZE, /* write one sector */ \
-				       TASK_FS,				\
-				       fsbuf);
+#define RD_SECT(dev,sect_nr) rd_sect(dev, sect_nr)
+#define WR_SECT(dev,sect_nr) wr_sect(dev, sect_nr)
+
+/**
+ * At most so many sector writes are held back in a batch
+ */
+#define NR_BATCH_SECTS	8
+
+/**
+ * @struct fs_req
+ * @brief  A request being served by FS, with a stack of its own so that it
+ *         can be parked while the driver is working for it, @see fs/main.c
+ */
+#define	NR_FS_REQS	4
+#define	FS_REQ_STACK	0x4000
+#define	REQ_FREE	0	/* waiting for a new request */
+#define	REQ_RUNNING	1
+#define	REQ_PARKED	2	/* waiting for a reply from `drv' */
+#define	REQ_READY	3	/* the reply has come, to be resumed */
+#define	REQ_WAITING	4	/* waiting for `wait_inode' to be unlocked */
+#define	NR_DRV_INFLIGHT	MB_IO_SLOTS	/* driver requests out at a time */
+struct fs_req {
+	MESSAGE		msg;		/* the request, and the reply */
+	struct proc *	caller;		/* who sent the request */
+	u8 *		buf;		/* its own part of the FS buffer */
+	int		buf_size;
+	int		state;		/* REQ_xxx */
+	int		may_park;	/* may it be parked on a driver? */
+	int		drv;		/* the driver it is parked on */
+	MESSAGE *	drv_msg;	/* where the driver's reply goes */
+	struct inode *	wait_inode;	/* the inode it is waiting for */
+	u32		esp;		/* saved when it is switched out */
+	u8		stack[FS_REQ_STACK];
+};
 
 	
 #endif /* _ORANGES_FS_H_ */
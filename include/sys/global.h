@@ -23,17 +23,16 @@ EXTERN	struct gate		idt[IDT_SIZE];
 EXTERN	u32	k_reenter;
 EXTERN	int	current_console;
 
-EXTERN	int	key_pressed; /**
-			      * used for clock_handler
-			      * to wake up TASK_TTY when
-			      * a key is pressed
-			      */
-
 EXTERN	struct tss	tss;
 EXTERN	struct proc*	p_proc_ready;
 
+EXTERN	int	trace_on;	/* record IPC events? @see kernel/trace.c */
+EXTERN	u32	trace_cnt;	/* how many have been recorded */
+
 extern	char		task_stack[];
 extern	struct proc	proc_table[];
+extern	struct kinfo	kinfo[];
+extern	struct trace_rec trace_ring[];
 extern  struct task	task_table[];
 extern  struct task	user_proc_table[];
 extern	irq_handler	irq_table[];
@@ -50,10 +49,13 @@ EXTERN	int			memory_size;
 EXTERN	struct file_desc	f_desc_table[NR_FILE_DESC];
 EXTERN	struct inode		inode_table[NR_INODE];
 EXTERN	struct super_block	super_block[NR_SUPER_BLOCK];
-extern	u8 *			fsbuf;
+extern	u8 *			fsbuf_area;
 extern	const int		FSBUF_SIZE;
-EXTERN	MESSAGE			fs_msg;
-EXTERN	struct proc *		pcaller;
+EXTERN	struct fs_req *		fs_cur;	/* the request being served */
+#define	fs_msg			(fs_cur->msg)
+#define	pcaller			(fs_cur->caller)
+#define	fsbuf			(fs_cur->buf)
+#define	fsbuf_size		(fs_cur->buf_size)
 EXTERN	struct inode *		root_inode;
 extern	struct dev_drv_map	dd_map[];
 
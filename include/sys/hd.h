@@ -225,33 +225,72 @@ struct part_ent {
 #define REG_DRV_ADDR	0x3F7		/*	Drive Address			I		*/
 
 #define MAX_IO_BYTES	256	/* how many sectors does one IO can handle */
+#define MAX_IO_SECTS_EXT 65536	/* ... and one LBA48 IO */
 
 #define RWBUF_SIZE 10                                      //缓存区大小为10个单位
+#define	RWBUF_FILL_MAX	2	/* only transfers of so many sectors are buffered */
 
 struct hd_cmd {
 	u8	features;
-	u8	count;
+	u16	count;		/* the high byte is for LBA48 only */
 	u8	lba_low;
 	u8	lba_mid;
 	u8	lba_high;
+	u8	lba_low_exp;	/* LBA48: bits 24-31 */
+	u8	lba_mid_exp;	/* LBA48: bits 32-39 */
+	u8	lba_high_exp;	/* LBA48: bits 40-47 */
 	u8	device;
 	u8	command;
 };
 
 struct part_info {
-	u32	base;	/* # of start sector (NOT byte offset, but SECTOR) */
-	u32	size;	/* how many sectors in this partition */
+	u64	base;	/* # of start sector (NOT byte offset, but SECTOR) */
+	u64	size;	/* how many sectors in this partition */
 };
 
 /* main drive struct, one entry per drive */
 struct hd_info
 {
 	int			open_cnt;
+	int			mult_sects;	/* sectors per READ/WRITE
+						   MULTIPLE block, 0 if
+						   not supported */
+	int			io32;		/* 32-bit data port I/O? */
+	int			dma;		/* bus master DMA? */
+	int			lba48;		/* 48-bit address feature
+						   set supported? */
 	struct part_info	primary[NR_PRIM_PER_DRIVE];
 	struct part_info	logical[NR_SUB_PER_DRIVE];
 };
 
 
+/**
+ * @struct hd_req
+ * @brief  A pending DEV_READ or DEV_WRITE, @see hd_dispatch()
+ */
+#define	NR_HD_REQS	16
+#define	HD_MAX_PASS	8	/* times a request may be passed over */
+struct hd_req {
+	int			busy;
+	MESSAGE			msg;		/* the request, and the reply */
+	int			drive;
+	u64			sect_nr;	/* LBA of the 1st sector */
+	int			nr_sects;
+	void *			la;		/* the buffer, linear addr */
+	u32			seq;		/* arrival order */
+	int			passed;		/* times others went first */
+	struct svc_stat *	svc;		/* @see svc_begin() */
+	u64			t0;
+};
+
+/* where a transfer over the buffers of merged requests is */
+struct hd_cursor {
+	struct hd_req **	parts;
+	int			i;		/* parts[i] */
+	int			off;		/* bytes done in parts[i] */
+};
+
+
 struct buf_node{                                                    //缓存区单位
 	u8 secbuf[SECTOR_SIZE];                   //数据存放
 	//u8 valid;                                //是否有效
@@ -274,6 +313,53 @@ struct rw_buf{                             //链表
 #define ATA_IDENTIFY		0xEC
 #define ATA_READ		0x20
 #define ATA_WRITE		0x30
+#define ATA_READ_MULTIPLE	0xC4
+#define ATA_WRITE_MULTIPLE	0xC5
+#define ATA_SET_MULTIPLE	0xC6
+#define	MAX_MULT_SECTS		16	/* the most we ask SET MULTIPLE for */
+#define ATA_READ_DMA		0xC8
+#define ATA_WRITE_DMA		0xCA
+#define ATA_READ_EXT		0x24	/* LBA48 */
+#define ATA_READ_DMA_EXT	0x25
+#define ATA_READ_MULTIPLE_EXT	0x29
+#define ATA_WRITE_EXT		0x34
+#define ATA_WRITE_DMA_EXT	0x35
+#define ATA_WRITE_MULTIPLE_EXT	0x39
+
+/* PCI configuration space, @see find_bmide() */
+#define	PCI_CONFIG_ADDR		0xCF8
+#define	PCI_CONFIG_DATA		0xCFC
+#define	PCI_COMMAND		0x04
+#define	PCI_CLASS		0x08	/* class, subclass, prog if, rev */
+#define	PCI_BAR4		0x20	/* Bus Master IDE base */
+#define	PCI_CMD_IO		0x01
+#define	PCI_CMD_MASTER		0x04
+#define	PCI_CLASS_IDE		0x0101	/* mass storage, IDE */
+
+/* Bus Master IDE registers of the primary channel, from the BMIDE base */
+#define	BM_CMD			0
+#define	BM_STATUS		2
+#define	BM_PRDT			4	/* physical addr of the PRD table */
+#define	BM_CMD_START		0x01
+#define	BM_CMD_READ		0x08	/* the controller writes memory */
+#define	BM_ST_ERR		0x02
+#define	BM_ST_INT		0x04
+
+/* Physical Region Descriptor, none may cross a 64K boundary */
+struct prd {
+	u32	base;	/* physical addr, even */
+	u16	cnt;	/* bytes, 0 for 64K */
+	u16	flags;
+};
+#define	PRD_EOT			0x8000	/* the last one of the table */
+#define	NR_PRDS			(MAX_IO_SECTS_EXT * SECTOR_SIZE / 0x10000 + \
+				 2 * NR_HD_REQS)
+/**
+ * The table itself must not cross a 64K boundary either, so it is put in
+ * a block of PRD_AREA_SIZE aligned to its size, a power of 2 which can hold
+ * NR_PRDS entries.
+ */
+#define	PRD_AREA_SIZE		0x2000
 /* for DEVICE register. */
 #define	MAKE_DEVICE_REG(lba,drv,lba_highest) (((lba) << 6) |		\
 					      ((drv) << 4) |		\
@@ -28,6 +28,59 @@ struct stackframe {	/* proc_ptr points here				↑ Low			*/
 };
 
 
+/**
+ * A timer in the timer wheel, @see kernel/timer.c
+ */
+struct timer {
+	struct timer *	next;
+	struct timer *	prev;
+	struct timer **	slot;	/* the list it is in, 0 if not pending */
+	u32		expires;
+	void		(*func)(struct timer * t); /* called in ring 0 */
+	int		data;	/* for func() */
+};
+
+#define timer_pending(t)	((t)->slot != 0)
+
+
+/**
+ * A window in a proc's memory that another proc may access,
+ * @see kernel/grant.c
+ */
+struct grant {
+	int	g_rights;	/* GRANT_READ | GRANT_WRITE, 0 if not in use */
+	int	g_grantee;	/* who may access the window */
+	int	g_fwd;		/* whom the grantee handed it on to */
+	void *	g_addr;		/* va of the window in the granter */
+	int	g_len;
+};
+
+/**
+ * @struct trace_rec
+ * One IPC event in the trace ring, @see kernel/trace.c
+ */
+struct trace_rec {
+	u64	tr_tsc;		/* when */
+	u16	tr_type;	/* msg type, or p_flags for TRC_BLOCK */
+	u8	tr_event;	/* TRC_xxx */
+	u8	tr_qdepth;	/* msgs waiting for dst afterwards */
+	short	tr_src;
+	short	tr_dst;
+};
+
+/**
+ * @struct trace_hdr
+ * The first sector of a trace dump, followed by the ring.
+ */
+struct trace_hdr {
+	char	th_magic[8];	/* "IPCTRACE" */
+	u32	th_nr_recs;	/* NR_TRACE_RECS */
+	u32	th_cnt;		/* events ever recorded, the latest ones are kept */
+	u64	th_boot_tsc;	/* ns = (tsc - boot_tsc) * mult >> shift */
+	u32	th_tsc_mult;
+	int	th_tsc_shift;
+};
+
 struct proc {
 	struct stackframe regs;    /* process registers saved in stack frame */
 
@@ -37,6 +90,31 @@ struct proc {
         int ticks;                 /* remained ticks */
         int priority;
 
+	int q_prio;                /**
+				    * dynamic priority, i.e. which run queue
+				    * the proc is in (0 ~ NR_SCHED_QUEUES-1)
+				    */
+	int q_boosted;             /**
+				    * nonzero if q_prio is inherited from a
+				    * sender waiting on this proc, and the
+				    * proc's own level is kept in q_own
+				    */
+	int q_own;
+	int in_rq;                 /* nonzero if linked in a run queue */
+	struct proc * next_ready;  /* next proc in the same run queue */
+
+	/* accounting, @see struct proc_stat */
+	int user_ticks;
+	int sys_ticks;
+	int nr_vol_sw;
+	int nr_invol_sw;
+	int nr_sent;
+	int nr_recv;
+	int send_ticks;
+	int recv_ticks;
+	int blk_since;             /* `ticks' when the proc was blocked */
+	int blk_flags;             /* SENDING or RECEIVING */
+
 	/* u32 pid;                   /\* process id passed in from MM *\/ */
 	char name[16];		   /* name of the process */
 
@@ -48,20 +126,49 @@ struct proc {
 	MESSAGE * p_msg;
 	int p_recvfrom;
 	int p_sendto;
+	int p_sendrec;             /**
+				    * nonzero if the proc is SENDING as the
+				    * first half of a BOTH, so that it will
+				    * be RECEIVING once the msg is taken
+				    */
+	int p_short;               /**
+				    * nonzero if the latest sendrec was a
+				    * short one, thus p_msg points to
+				    * short_msg, @see sys_sendrec_short()
+				    */
+	MESSAGE short_msg;
+
+	MESSAGE mailbox[MAILBOX_SIZE]; /**
+					* ring of async msgs sent to this
+					* proc, @see msg_send_async()
+					*/
+	int mb_head;               /* index of the oldest msg in mailbox */
+	int mb_cnt;                /* number of msgs in mailbox */
+	int mb_io_cnt;             /**
+				    * DEV_READ and DEV_WRITE among them,
+				    * @see msg_send_async()
+				    */
 
-	int has_int_msg;           /**
-				    * nonzero if an INTERRUPT occurred when
-				    * the task is not ready to deal with it.
+	u32 int_pending;           /**
+				    * bit n is set if IRQ n occurred when
+				    * the task is not ready to deal with it,
+				    * @see inform_int()
 				    */
+	int int_cnt;               /* how many interrupts are pending */
 
 	struct proc * q_sending;   /**
 				    * queue of procs sending messages to
-				    * this proc
+				    * this proc, in order of q_prio, FIFO
+				    * among the same level
 				    */
+	struct proc * q_sending_tail;
 	struct proc * next_sending;/**
 				    * next proc in the sending
 				    * queue (q_sending)
 				    */
+	struct proc * prev_sending;
+
+	struct grant grants[NR_GRANTS]; /* windows granted to others */
 
 	int p_parent; /**< pid of parent process */
 
@@ -79,12 +186,25 @@ struct task {
 #define proc2pid(x) (x - proc_table)
 
 /* Number of tasks & processes */
-#define NR_TASKS		5
+#define NR_TASKS		6
 #define NR_PROCS		32
-#define NR_NATIVE_PROCS		4
+#define NR_NATIVE_PROCS		1
 #define FIRST_PROC		proc_table[0]
 #define LAST_PROC		proc_table[NR_TASKS + NR_PROCS - 1]
 
+/**
+ * Run queues. There is one queue per priority, the higher the number the
+ * higher the priority. Tasks stay in TASK_Q, while user procs move between
+ * MIN_USER_Q and MAX_USER_Q: a proc using up its time slice is demoted,
+ * a proc blocking on IPC before that is promoted. IDLE_Q holds TASK_IDLE
+ * only, so there is always something to run.
+ */
+#define NR_SCHED_QUEUES		16
+#define TASK_Q			15
+#define MAX_USER_Q		8
+#define MIN_USER_Q		1
+#define IDLE_Q			0
+
 /**
  * All forked proc will use memory above PROCS_BASE.
  *
@@ -104,18 +224,14 @@ struct task {
 #define STACK_SIZE_HD		STACK_SIZE_DEFAULT
 #define STACK_SIZE_FS		STACK_SIZE_DEFAULT
 #define STACK_SIZE_MM		STACK_SIZE_DEFAULT
+#define STACK_SIZE_IDLE		STACK_SIZE_DEFAULT
 #define STACK_SIZE_INIT		STACK_SIZE_DEFAULT
-#define STACK_SIZE_TESTA	STACK_SIZE_DEFAULT
-#define STACK_SIZE_TESTB	STACK_SIZE_DEFAULT
-#define STACK_SIZE_TESTC	STACK_SIZE_DEFAULT
 
 #define STACK_SIZE_TOTAL	(STACK_SIZE_TTY + \
 				STACK_SIZE_SYS + \
 				STACK_SIZE_HD + \
 				STACK_SIZE_FS + \
 				STACK_SIZE_MM + \
-				STACK_SIZE_INIT + \
-				STACK_SIZE_TESTA + \
-				STACK_SIZE_TESTB + \
-				STACK_SIZE_TESTC)
+				STACK_SIZE_IDLE + \
+				STACK_SIZE_INIT)
 
@@ -84,10 +84,11 @@ struct tss {
 #define	SELECTOR_KERNEL_GS	SELECTOR_VIDEO
 
 /* 每个任务有一个单独的 LDT, 每个 LDT 中的描述符个数: */
-#define LDT_SIZE		2
+#define LDT_SIZE		3
 /* descriptor indices in LDT */
 #define INDEX_LDT_C             0
 #define INDEX_LDT_RW            1
+#define INDEX_LDT_INFO          2	/* kernel info page, @see kinfo.c */
 
 /* 描述符类型值说明 */
 #define	DA_32			0x4000	/* 32 位段				*/
@@ -8,14 +8,22 @@
 /* kliba.asm */
 PUBLIC void	out_byte(u16 port, u8 value);
 PUBLIC u8	in_byte(u16 port);
+PUBLIC void	out_dword(u16 port, u32 value);
+PUBLIC u32	in_dword(u16 port);
 PUBLIC void	disp_str(char * info);
 PUBLIC void	disp_color_str(char * info, int color);
 PUBLIC void	disable_irq(int irq);
 PUBLIC void	enable_irq(int irq);
 PUBLIC void	disable_int();
 PUBLIC void	enable_int();
+PUBLIC u32	save_and_disable_int();
+PUBLIC void	restore_int(u32 eflags);
+PUBLIC u64	read_tsc();
+PUBLIC void	switch_stack(u32 * old_esp, u32 new_esp);
 PUBLIC void	port_read(u16 port, void* buf, int n);
 PUBLIC void	port_write(u16 port, void* buf, int n);
+PUBLIC void	port_read32(u16 port, void* buf, int n);
+PUBLIC void	port_write32(u16 port, void* buf, int n);
 PUBLIC void	glitter(int row, int col);
 
 /* string.asm */
@@ -39,10 +47,7 @@ PUBLIC void restart();
 
 /* main.c */
 PUBLIC void Init();
-PUBLIC int  get_ticks();
-PUBLIC void TestA();
-PUBLIC void TestB();
-PUBLIC void TestC();
+PUBLIC void task_idle();
 PUBLIC void panic(const char *fmt, ...);
 
 /* i8259.c */
@@ -54,6 +59,28 @@ PUBLIC void spurious_irq(int irq);
 PUBLIC void clock_handler(int irq);
 PUBLIC void init_clock();
 PUBLIC void milli_delay(int milli_sec);
+PUBLIC int  sys_halt(int _unused1, int _unused2, int _unused3, struct proc* p);
+
+/* kinfo.c */
+PUBLIC void init_kinfo(struct proc * p);
+PUBLIC void update_kinfo();
+PUBLIC void set_kinfo_tsc(u64 boot_tsc, u32 mult, int shift);
+PUBLIC void set_kinfo_rtc(u32 sec, u64 ns);
+
+/* timer.c */
+PUBLIC void set_timer(struct timer * t, int nr_ticks,
+		      void (*func)(struct timer * t), int data);
+PUBLIC void reset_timer(struct timer * t);
+PUBLIC void run_timers(int nr_ticks);
+PUBLIC int  next_timer(int max);
+
+/* trace.c */
+PUBLIC void  trace_event(int event, int src, int dst, int type);
+
+/* grant.c */
+PUBLIC int   grant_fwd(int granter, int gid, int grantee, int to);
+PUBLIC void* grant_la(int granter, int gid, int user, int off, int len,
+		      int rights);
 
 /* kernel/hd.c */
 PUBLIC void task_hd();
@@ -75,6 +102,20 @@ PUBLIC void task_sys();
 PUBLIC void			task_fs();
 PUBLIC int			rw_sector(int io_type, int dev, u64 pos,
 					  int bytes, int proc_nr, void * buf);
+PUBLIC int			rw_sector_grant(int io_type, int dev, u64 pos,
+						int bytes, int granter, int gid,
+						int off);
+PUBLIC int			rd_sect(int dev, int sect_nr);
+PUBLIC int			wr_sect(int dev, int sect_nr);
+PUBLIC void			fs_may_park(int on);
+PUBLIC void			fs_lock_inode(struct inode * pin);
+PUBLIC void			fs_unlock_inode(struct inode * pin);
+PUBLIC void			fs_chr_call(int drv, MESSAGE * m);
+PUBLIC void			fs_drv_call(int drv, MESSAGE * m);
+PUBLIC void			fs_drv_submit(int drv, MESSAGE * m);
+PUBLIC void			fs_drv_wait(int drv, MESSAGE * m);
+PUBLIC void			begin_batch();
+PUBLIC int			end_batch();
 PUBLIC struct inode *		get_inode(int dev, int num);
 PUBLIC void			put_inode(struct inode * pinode);
 PUBLIC void			sync_inode(struct inode * p);
@@ -97,9 +138,16 @@ PUBLIC int		strip_path(char * filename, const char * pathname,
 				   struct inode** ppinode);
 PUBLIC int		search_file(char * path);
 
+/* fs/ring.c */
+PUBLIC void		init_ring();
+PUBLIC int		do_ring_setup();
+PUBLIC int		do_ring_enter();
+PUBLIC void		ring_exit(int pid);
+
 /* fs/disklog.c */
 PUBLIC int		do_disklog();
 PUBLIC int		disklog(char * logstr); /* for debug */
+PUBLIC int		do_trace_dump();
 PUBLIC void		dump_fd_graph(const char * fmt, ...);
 
 /* mm/main.c */
@@ -124,27 +172,50 @@ PUBLIC int  is_current_console(CONSOLE* p_con);
 
 /* proc.c */
 PUBLIC	void	schedule();
+PUBLIC	void	sched_sync(struct proc* p);
 PUBLIC	void*	va2la(int pid, void* va);
 PUBLIC	int	ldt_seg_linear(struct proc* p, int idx);
 PUBLIC	void	reset_msg(MESSAGE* p);
 PUBLIC	void	dump_msg(const char * title, MESSAGE* m);
 PUBLIC	void	dump_proc(struct proc * p);
 PUBLIC	int	send_recv(int function, int src_dest, MESSAGE* msg);
-PUBLIC void	inform_int(int task_nr);
+PUBLIC	int	send_recv_short(int function, int src_dest, MESSAGE* msg);
+PUBLIC	void	send_async(int dest, MESSAGE* msg);
+PUBLIC	void	send_async_vec(int n, int* dests, MESSAGE* msgs);
+PUBLIC	int	recv_timed(int src, MESSAGE* msg, int nr_ticks);
+PUBLIC	int	recv_timed_ns(int src, MESSAGE* msg, u64 ns);
+PUBLIC	int	grant(int grantee, void* addr, int len, int rights);
+PUBLIC void	inform_int(int task_nr, int irq);
 
 /* lib/misc.c */
 PUBLIC void spin(char * func_name);
 
+/* lib/svcstat.c */
+PUBLIC struct svc_stat* svc_begin(struct svc_stat * tab, int type, u64 * t0);
+PUBLIC void	svc_end(struct svc_stat * s, u64 t0);
+PUBLIC int	svc_query(struct svc_stat * tab, MESSAGE * m);
+
 /* 以下是系统调用相关 */
 
 /* 系统调用 - 系统级 */
 /* proc.c */
 PUBLIC	int	sys_sendrec(int function, int src_dest, MESSAGE* m, struct proc* p);
+PUBLIC	int	sys_sendrec_short(int fn_src, int type, int w1, struct proc* p);
+PUBLIC	int	sys_sendvec(int n, int* dests, MESSAGE* msgs, struct proc* p);
 PUBLIC	int	sys_printx(int _unused1, int _unused2, char* s, struct proc * p_proc);
 
+/* grant.c */
+PUBLIC	int	sys_mkgrant(int grantee_rights, void* addr, int len, struct proc* p);
+PUBLIC	int	sys_rmgrant(int gid, int _unused2, int _unused3, struct proc* p);
+
 /* syscall.asm */
 PUBLIC  void    sys_call();             /* int_handler */
 
 /* 系统调用 - 用户级 */
 PUBLIC	int	sendrec(int function, int src_dest, MESSAGE* p_msg);
+PUBLIC	int	sendrec_short(int function, int src_dest, MESSAGE* p_msg);
+PUBLIC	int	sendvec(int n, int* dests, MESSAGE* msgs);
 PUBLIC	int	printx(char* str);
+PUBLIC	int	mkgrant(int grantee_rights, void* addr, int len);
+PUBLIC	int	rmgrant(int gid);
+PUBLIC	void	halt();
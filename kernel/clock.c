@@ -19,6 +19,16 @@
 #include "global.h"
 #include "proto.h"
 
+#define	TICK_COUNT	(TIMER_FREQ / HZ)	/* PIT counts per tick */
+#define	MAX_ONESHOT	(0xFFFF / TICK_COUNT)	/* ticks, bounded by the
+						 * 16-bit counter */
+
+PRIVATE int	oneshot_ticks;	/* nonzero iff the PIT is in one-shot mode */
+PRIVATE int	tick_residue;	/* PIT counts not yet turned into a tick */
+
+PRIVATE void	start_oneshot(int nr);
+PRIVATE void	stop_oneshot();
+PRIVATE void	calibrate_tsc();
 
 /*****************************************************************************
  *                                clock_handler
@@ -31,14 +41,27 @@
  *****************************************************************************/
 PUBLIC void clock_handler(int irq)
 {
-	if (++ticks >= MAX_TICKS)
-		ticks = 0;
+	int n = 1;
+
+	if (oneshot_ticks) {	/* the CPU has been idle for a while */
+		n = oneshot_ticks;
+		oneshot_ticks = 0;
+	}
 
-	if (p_proc_ready->ticks)
-		p_proc_ready->ticks--;
+	ticks += n;
+	if (ticks >= MAX_TICKS)
+		ticks -= MAX_TICKS;
 
-	if (key_pressed)
-		inform_int(TASK_TTY);
+	update_kinfo();
+	run_timers(n);
+
+	/* k_reenter is nonzero iff the interrupt came from the kernel */
+	if (k_reenter != 0)
+		p_proc_ready->sys_ticks += n;
+	else
+		p_proc_ready->user_ticks += n;
+
+	p_proc_ready->ticks = max(p_proc_ready->ticks - n, 0);
 
 	if (k_reenter != 0) {
 		return;
@@ -56,15 +79,115 @@ PUBLIC void clock_handler(int irq)
  *                                milli_delay
  *****************************************************************************/
 /**
- * <Ring 1~3> Delay for a specified amount of time.
+ * <Ring 1~3> Delay for a specified amount of time. The caller sleeps
+ * instead of spinning, @see usleep().
  * 
  * @param milli_sec How many milliseconds to delay.
  *****************************************************************************/
 PUBLIC void milli_delay(int milli_sec)
 {
-        int t = get_ticks();
+	usleep(milli_sec * 1000);
+}
+
+/*****************************************************************************
+ *                                sys_halt
+ *****************************************************************************/
+/**
+ * <Ring 0> The core routine of system call `halt()'. Stop the CPU until the
+ * next interrupt arrives.
+ *
+ * Nothing happens on a tick while the CPU is idle, so the periodic tick is
+ * stopped and the PIT is told to fire only once, when the next timer is due
+ * or as late as the PIT can. If some
+ * other interrupt wakes us up earlier, the time elapsed is read back from
+ * the PIT and the periodic tick is restarted.
+ *
+ * Only TASK_IDLE may halt, and only while it is still p_proc_ready: anyone
+ * made runnable by an interrupt handler takes p_proc_ready over at once (see
+ * unblock()), and the other ways of waking a proc need a running task.
+ * 
+ * @param p  The caller proc.
+ * 
+ * @return Zero if success.
+ *****************************************************************************/
+PUBLIC int sys_halt(int _unused1, int _unused2, int _unused3, struct proc* p)
+{
+	if (p != &proc_table[TASK_IDLE])
+		return -1;
+
+	disable_int();
+	if (p_proc_ready == p) {
+		start_oneshot(next_timer(MAX_ONESHOT));
+		/* no interrupt can sneak in between `sti' and `hlt' */
+		__asm__ __volatile__("sti\n\thlt\n\tcli");
+		stop_oneshot();
+	}
+	enable_int();
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                start_oneshot
+ *****************************************************************************/
+/**
+ * <Ring 0> Let the PIT interrupt once after the given number of ticks
+ * instead of every tick.
+ *
+ * @attention Interrupts must be disabled by the caller.
+ * 
+ * @param nr  How many ticks, no more than MAX_ONESHOT.
+ *****************************************************************************/
+PRIVATE void start_oneshot(int nr)
+{
+	u16 cnt = nr * TICK_COUNT - tick_residue;
+
+	out_byte(TIMER_MODE, ONE_SHOT);
+	out_byte(TIMER0, (u8)cnt);
+	out_byte(TIMER0, (u8)(cnt >> 8));
 
-        while(((get_ticks() - t) * 1000 / HZ) < milli_sec) {}
+	oneshot_ticks = nr;
+	tick_residue = 0;
+}
+
+/*****************************************************************************
+ *                                stop_oneshot
+ *****************************************************************************/
+/**
+ * <Ring 0> Account for the ticks elapsed since start_oneshot() and go back
+ * to the periodic mode.
+ *
+ * If the one-shot interrupt has not been handled yet, the count left is read
+ * back from the PIT, the whole ticks elapsed are added to `ticks' and the
+ * rest is kept in `tick_residue' for the next idle period. If the PIT has
+ * already reached the terminal count, the interrupt is pending and
+ * clock_handler() will account for it.
+ *
+ * @attention Interrupts must be disabled by the caller.
+ *****************************************************************************/
+PRIVATE void stop_oneshot()
+{
+	if (oneshot_ticks) {
+		out_byte(TIMER_MODE, READ_BACK0);
+		u8 status = in_byte(TIMER0);
+		u16 left = in_byte(TIMER0);
+		left |= in_byte(TIMER0) << 8;
+
+		if (!(status & 0x80)) { /* OUT is still low */
+			int elapsed = oneshot_ticks * TICK_COUNT - left;
+			ticks += elapsed / TICK_COUNT;
+			if (ticks >= MAX_TICKS)
+				ticks -= MAX_TICKS;
+			update_kinfo();
+			run_timers(elapsed / TICK_COUNT);
+			tick_residue = elapsed % TICK_COUNT;
+			oneshot_ticks = 0;
+		}
+	}
+
+	out_byte(TIMER_MODE, RATE_GENERATOR);
+	out_byte(TIMER0, (u8) TICK_COUNT);
+	out_byte(TIMER0, (u8) (TICK_COUNT >> 8));
 }
 
 /*****************************************************************************
@@ -76,6 +199,8 @@ PUBLIC void milli_delay(int milli_sec)
  *****************************************************************************/
 PUBLIC void init_clock()
 {
+	calibrate_tsc();
+
         /* 初始化 8253 PIT */
         out_byte(TIMER_MODE, RATE_GENERATOR);
         out_byte(TIMER0, (u8) (TIMER_FREQ/HZ) );
@@ -85,4 +210,39 @@ PUBLIC void init_clock()
         enable_irq(CLOCK_IRQ);                        /* 让8259A可以接收时钟中断 */
 }
 
+/*****************************************************************************
+ *                                calibrate_tsc
+ *****************************************************************************/
+/**
+ * <Ring 0> Find out how fast the TSC runs by letting the PIT count down
+ * 50ms, and make clock_ns() start from zero here.
+ * 
+ *****************************************************************************/
+PRIVATE void calibrate_tsc()
+{
+	u16 cnt = TIMER_FREQ / 20;	/* 50 ms */
 
+	out_byte(TIMER_MODE, ONE_SHOT);
+	out_byte(TIMER0, (u8)cnt);
+	out_byte(TIMER0, (u8)(cnt >> 8));
+
+	u64 t0 = read_tsc();
+	do {
+		out_byte(TIMER_MODE, READ_STATUS0);
+	} while (!(in_byte(TIMER0) & 0x80)); /* until OUT goes high */
+	u64 t1 = read_tsc();
+
+	u32 khz = (u32)(t1 - t0) / 50;
+	assert(khz);
+
+	/* ns per TSC cycle, in fixed point, as precise as 32 bits allow */
+	u64 mult = 1000000ULL << 32;
+	int shift = 32;
+	div64(&mult, khz);
+	while (mult >> 32) {
+		mult >>= 1;
+		shift--;
+	}
+
+	set_kinfo_tsc(t1, (u32)mult, shift);
+}
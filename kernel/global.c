@@ -23,6 +23,10 @@
 
 PUBLIC	struct proc proc_table[NR_TASKS + NR_PROCS];
 
+PUBLIC	struct kinfo	kinfo[NR_TASKS + NR_PROCS];
+
+PUBLIC	struct trace_rec trace_ring[NR_TRACE_RECS];
+
 /* 注意下面的 TASK 的顺序要与 const.h 中对应 */
 PUBLIC	struct task	task_table[NR_TASKS] = {
 	/* entry        stack size        task name */
@@ -31,19 +35,13 @@ PUBLIC	struct task	task_table[NR_TASKS] = {
 	{task_sys,      STACK_SIZE_SYS,   "SYS"       },
 	{task_hd,       STACK_SIZE_HD,    "HD"        },
 	{task_fs,       STACK_SIZE_FS,    "FS"        },
-	{task_mm,       STACK_SIZE_MM,    "MM"        }};
+	{task_mm,       STACK_SIZE_MM,    "MM"        },
+	{task_idle,     STACK_SIZE_IDLE,  "IDLE"      }};
 
 PUBLIC	struct task	user_proc_table[NR_NATIVE_PROCS] = {
 	/* entry    stack size     proc name */
 	/* -----    ----------     --------- */
-	{Init,   STACK_SIZE_INIT,  "INIT" },
-	{TestA,  STACK_SIZE_TESTA, "TestA"},
-	{TestB,  STACK_SIZE_TESTB, "TestB"},
-	{TestC,  STACK_SIZE_TESTC, "TestC"}};
-/* PUBLIC	struct task	user_proc_table[NR_PROCS] = { */
-/* 	{TestA, STACK_SIZE_TESTA, "TestA"}, */
-/* 	{TestB, STACK_SIZE_TESTB, "TestB"}, */
-/* 	{TestC, STACK_SIZE_TESTC, "TestC"}}; */
+	{Init,   STACK_SIZE_INIT,  "INIT" }};
 
 PUBLIC	char		task_stack[STACK_SIZE_TOTAL];
 
@@ -53,7 +51,12 @@ PUBLIC	CONSOLE		console_table[NR_CONSOLES];
 PUBLIC	irq_handler	irq_table[NR_IRQ];
 
 PUBLIC	system_call	sys_call_table[NR_SYS_CALL] = {sys_printx,
-						       sys_sendrec};
+						       sys_sendrec,
+						       sys_halt,
+						       sys_sendrec_short,
+						       sys_mkgrant,
+						       sys_rmgrant,
+						       sys_sendvec};
 
 /* FS related below */
 /*****************************************************************************/
@@ -77,7 +80,7 @@ struct dev_drv_map dd_map[] = {
 /**
  * 6MB~7MB: buffer for FS
  */
-PUBLIC	u8 *		fsbuf		= (u8*)0x600000;
+PUBLIC	u8 *		fsbuf_area	= (u8*)0x600000;
 PUBLIC	const int	FSBUF_SIZE	= 0x100000;
 
 
@@ -0,0 +1,176 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   grant.c
+ * @brief  Memory grants.
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/**
+ * A grant is a window in the granter's memory which one certain proc, the
+ * grantee, may read or write. The granter passes the grant's index (gid) in
+ * a MESSAGE, and the grantee may hand it on to one more proc, e.g. FS to the
+ * disk driver. A driver then gets the linear address of the window through
+ * grant_la() and transfers data to or from it directly, instead of bouncing
+ * them through a buffer of its own.
+ */
+
+PRIVATE struct grant* get_grant(int granter, int gid);
+
+/*****************************************************************************
+ *                                sys_mkgrant
+ *****************************************************************************/
+/**
+ * <Ring 0> The core routine of system call `mkgrant()'.
+ *
+ * @param grantee_rights  (grantee << 2) | rights, rights is GRANT_READ,
+ *                        GRANT_WRITE or both.
+ * @param addr            Start of the window, in the caller's space.
+ * @param len             Length of the window.
+ * @param p               The caller proc.
+ *
+ * @return The gid, or NO_GRANT if the window is invalid or there is no
+ *         free slot.
+ *****************************************************************************/
+PUBLIC int sys_mkgrant(int grantee_rights, void* addr, int len, struct proc* p)
+{
+	int grantee = grantee_rights >> 2;
+	int rights = grantee_rights & (GRANT_READ | GRANT_WRITE);
+
+	if (grantee < 0 || grantee >= NR_TASKS + NR_PROCS ||
+	    rights == 0 || len <= 0)
+		return NO_GRANT;
+
+	/* the window must lie in the caller's data segment */
+	struct descriptor * d = &p->ldts[INDEX_LDT_RW];
+	u32 limit = (d->limit_high_attr2 & 0xF) << 16 | d->limit_low;
+	if (d->limit_high_attr2 & (DA_LIMIT_4K >> 8))
+		limit = limit << 12 | 0xFFF;
+	if ((u32)addr > limit || (u32)len - 1 > limit - (u32)addr)
+		return NO_GRANT;
+
+	int gid;
+	for (gid = 0; gid < NR_GRANTS; gid++) {
+		struct grant * g = &p->grants[gid];
+		if (g->g_rights == 0) {
+			g->g_grantee = grantee;
+			g->g_fwd = NO_TASK;
+			g->g_rights = rights;
+			g->g_addr = addr;
+			g->g_len = len;
+			return gid;
+		}
+	}
+
+	return NO_GRANT;
+}
+
+/*****************************************************************************
+ *                                sys_rmgrant
+ *****************************************************************************/
+/**
+ * <Ring 0> The core routine of system call `rmgrant()'.
+ *
+ * @param gid  The grant to revoke.
+ * @param p    The caller proc.
+ *
+ * @return Zero if success.
+ *****************************************************************************/
+PUBLIC int sys_rmgrant(int gid, int _unused2, int _unused3, struct proc* p)
+{
+	if (gid < 0 || gid >= NR_GRANTS)
+		return -1;
+
+	p->grants[gid].g_rights = 0;
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                get_grant
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Find a grant in use.
+ *
+ * @param granter  Whose memory.
+ * @param gid      Which grant.
+ *
+ * @return Ptr to the grant, 0 if there is no such grant.
+ *****************************************************************************/
+PRIVATE struct grant* get_grant(int granter, int gid)
+{
+	if (granter < 0 || granter >= NR_TASKS + NR_PROCS ||
+	    gid < 0 || gid >= NR_GRANTS)
+		return 0;
+
+	struct grant * g = &proc_table[granter].grants[gid];
+
+	return g->g_rights ? g : 0;
+}
+
+/*****************************************************************************
+ *                                grant_fwd
+ *****************************************************************************/
+/**
+ * <Ring 1> Let another proc use a grant made to the caller, typically a
+ * driver which will do the transfer on the caller's behalf.
+ *
+ * @param granter  Whose memory.
+ * @param gid      Which grant.
+ * @param grantee  The caller, who must be the grantee.
+ * @param to       Who may use the grant as well from now on.
+ *
+ * @return Zero if success.
+ *****************************************************************************/
+PUBLIC int grant_fwd(int granter, int gid, int grantee, int to)
+{
+	struct grant * g = get_grant(granter, gid);
+
+	if (!g || g->g_grantee != grantee)
+		return -1;
+
+	g->g_fwd = to;
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                grant_la
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Check an access to a grant and get its linear address.
+ *
+ * @param granter  Whose memory.
+ * @param gid      Which grant.
+ * @param user     Who is accessing the memory.
+ * @param off      Offset in the window.
+ * @param len      How many bytes will be accessed.
+ * @param rights   GRANT_READ and/or GRANT_WRITE.
+ *
+ * @return The linear address of the bytes, 0 if the access is not allowed.
+ *****************************************************************************/
+PUBLIC void* grant_la(int granter, int gid, int user, int off, int len,
+		      int rights)
+{
+	struct grant * g = get_grant(granter, gid);
+
+	if (!g || (g->g_grantee != user && g->g_fwd != user) ||
+	    (g->g_rights & rights) != rights ||
+	    off < 0 || len < 0 || off > g->g_len || len > g->g_len - off)
+		return 0;
+
+	return va2la(granter, g->g_addr + off);
+}
@@ -25,9 +25,35 @@
 PRIVATE void	init_hd			();
 PRIVATE void	hd_open			(int device);
 PRIVATE void	hd_close		(int device);
-PRIVATE void	hd_rdwt			(MESSAGE * p);
+PRIVATE void	hd_serve		(MESSAGE * msg);
+PRIVATE int	hd_enqueue		(MESSAGE * p, struct svc_stat * svc,
+					 u64 t0);
+PRIVATE int	hd_blocked		(struct hd_req * r);
+PRIVATE struct hd_req *	hd_pick		();
+PRIVATE int	hd_merge		(struct hd_req * r,
+					 struct hd_req ** parts);
+PRIVATE void	hd_dispatch		();
+PRIVATE void	cur_peek		(struct hd_cursor * c, void ** la,
+					 int * left);
+PRIVATE void	cur_advance		(struct hd_cursor * c, int n);
+PRIVATE int	hd_rdwt			(struct hd_req ** parts, int nr);
+PRIVATE void	hd_data_in		(int drive, void * buf, int bytes);
+PRIVATE void	hd_data_out		(int drive, void * buf, int bytes);
+PRIVATE void	hd_set_multiple		(int drive, u16 * hdinfo);
+PRIVATE int	hd_dma			(int type, int drive, u64 sect_nr,
+					 struct hd_cursor * c, int bytes);
+PRIVATE void	hd_fill_cache		(u64 sect_nr, void * la, int bytes);
+PRIVATE void	init_rwbuf		();
+PRIVATE struct buf_node*	rwexist	(u32 sec_nr);
+PRIVATE struct buf_node*	get_empty_buf	(u32 idx);
+PRIVATE void	invalid_buf		(u32 start, u32 end);
+PRIVATE void	hd_cmd_lba		(struct hd_cmd * cmd, int drive,
+					 u64 sect_nr, int count);
+PRIVATE void	find_bmide		();
+PRIVATE u32	pci_read		(u32 dev, int reg);
+PRIVATE void	pci_write		(u32 dev, int reg, u32 val);
 PRIVATE void	hd_ioctl		(MESSAGE * p);
-PRIVATE void	hd_cmd_out		(struct hd_cmd* cmd);
+PRIVATE int	hd_cmd_out		(struct hd_cmd* cmd);
 PRIVATE void	get_part_table		(int drive, int sect_nr, struct part_ent * entry);
 PRIVATE void	partition		(int device, int style);
 PRIVATE void	print_hdinfo		(struct hd_info * hdi);
@@ -38,10 +64,22 @@ PRIVATE void	print_identify_info	(u16* hdinfo);
 
 
 PRIVATE	u8		hd_status;
+PRIVATE	int		hd_ints;	/* interrupts got but not waited for */
 PRIVATE	u8		hdbuf[SECTOR_SIZE * 2];
 PRIVATE	struct hd_info	hd_info[1];
-
-//PUBLIC struct buf_node rwbuff[RWBUF_SIZE];                                           //缓存区
+PRIVATE	struct svc_stat	hd_svc[NR_SVC_TYPES];
+PRIVATE	u16		bmide_base;	/* 0 if there is no bus master IDE */
+PRIVATE	u8		prd_area[PRD_AREA_SIZE * 2];
+PRIVATE	struct prd *	prd_table;	/* in prd_area, PRD_AREA_SIZE aligned */
+PRIVATE	struct hd_req	hd_queue[NR_HD_REQS];	/* the pending requests */
+PRIVATE	int		hd_nr_pending;
+PRIVATE	u32		hd_seq;		/* arrival order of the requests */
+PRIVATE	u64		hd_head;	/* where the last request ended */
+PRIVATE	MESSAGE		hd_ctl_msg;	/* got while busy, @see interrupt_wait() */
+PRIVATE	int		hd_ctl_pending;
+
+PRIVATE	struct buf_node	rwbuf_nodes[RWBUF_SIZE];	/* all the nodes */
+PRIVATE	struct buf_node*	rwbuf_free;	/* those not in rwbuf */
 
 PUBLIC struct rw_buf rwbuf;                                                //链表缓冲区
 
@@ -54,6 +92,11 @@ PUBLIC struct rw_buf rwbuf;                                                //链
  *****************************************************************************/
 /**
  * Main loop of HD driver.
+ *
+ * DEV_READ and DEV_WRITE are not served at once but queued. All the msgs
+ * already sent are taken in before the disk is touched, so the elevator
+ * has something to choose from and to merge, @see hd_dispatch().
+ * Other msgs got while a command is in progress are served after it.
  * 
  *****************************************************************************/
 PUBLIC void task_hd()
@@ -63,36 +106,80 @@ PUBLIC void task_hd()
 	init_hd();
 
 	while (1) {
-		send_recv(RECEIVE, ANY, &msg);
-
-		int src = msg.source;
+		if (hd_ctl_pending) {
+			/* the slot may be refilled while it is served */
+			msg = hd_ctl_msg;
+			hd_ctl_pending = 0;
+			hd_serve(&msg);
+		}
 
-		switch (msg.type) {
-		case DEV_OPEN:
-			hd_open(msg.DEVICE);
-			break;
+		/* wait only if there is nothing to do */
+		if (hd_nr_pending == 0) {
+			send_recv(RECEIVE, ANY, &msg);
+			hd_serve(&msg);
+		}
 
-		case DEV_CLOSE:
-			hd_close(msg.DEVICE);
-			break;
+		while (hd_nr_pending < NR_HD_REQS &&
+		       recv_timed(ANY, &msg, 0) == 0)
+			hd_serve(&msg);
 
-		case DEV_READ:
-		case DEV_WRITE:
-			hd_rdwt(&msg);
-			break;
+		if (hd_nr_pending)
+			hd_dispatch();
+	}
+}
 
-		case DEV_IOCTL:
-			hd_ioctl(&msg);
-			break;
+/*****************************************************************************
+ *                                hd_serve
+ *****************************************************************************/
+/**
+ * <Ring 1> Serve a msg, or queue it if it is a DEV_READ or DEV_WRITE.
+ * 
+ * @param msg  The msg, and the reply.
+ *****************************************************************************/
+PRIVATE void hd_serve(MESSAGE * msg)
+{
+	int src = msg->source;
+
+	u64 t0;
+	struct svc_stat * svc = svc_begin(hd_svc, msg->type, &t0);
+
+	switch (msg->type) {
+	case DEV_OPEN:
+		hd_open(msg->DEVICE);
+		break;
+
+	case DEV_CLOSE:
+		hd_close(msg->DEVICE);
+		break;
+
+	case DEV_READ:
+	case DEV_WRITE:
+		if (hd_enqueue(msg, svc, t0))
+			return;	/* replied by hd_dispatch() */
+		break;
+
+	case DEV_IOCTL:
+		hd_ioctl(msg);
+		break;
+
+	case SVC_STAT:
+		msg->CNT = svc_query(hd_svc, msg);
+		msg->type = SYSCALL_RET;
+		break;
+
+	default:
+		dump_msg("HD driver::unknown msg", msg);
+		spin("FS::main_loop (invalid msg.type)");
+		break;
+	}
 
-		default:
-			dump_msg("HD driver::unknown msg", &msg);
-			spin("FS::main_loop (invalid msg.type)");
-			break;
-		}
+	svc_end(svc, t0);
 
-		send_recv(SEND, src, &msg);
-	}
+	/* a completion never blocks, @see fs_drv_submit() */
+	if (msg->type == DEV_READ || msg->type == DEV_WRITE)
+		send_async(src, msg);
+	else
+		send_recv(SEND, src, msg);
 }
 
 /*****************************************************************************
@@ -112,6 +199,8 @@ PRIVATE void init_hd()
 	printl("NrDrives:%d.\n", *pNrDrives);
 	assert(*pNrDrives);
 
+	find_bmide();
+
 	put_irq_handler(AT_WINI_IRQ, hd_handler);
 	enable_irq(CASCADE_IRQ);
 	enable_irq(AT_WINI_IRQ);
@@ -162,90 +251,594 @@ PRIVATE void hd_close(int device)
 
 
 /*****************************************************************************
- *                                hd_rdwt
+ *                                hd_enqueue
  *****************************************************************************/
 /**
- * <Ring 1> This routine handles DEV_READ and DEV_WRITE message.
+ * <Ring 1> Put a DEV_READ or DEV_WRITE into the pending queue.
+ * 
+ * @param p    Message ptr.
+ * @param svc  What svc_begin() returned for it.
+ * @param t0   The starting time svc_begin() gave.
  * 
- * @param p Message ptr.
+ * @return Zero if it has been served from the buffer and is to be replied
+ *         now, nonzero if it is queued.
  *****************************************************************************/
-PRIVATE void hd_rdwt(MESSAGE * p)
+PRIVATE int hd_enqueue(MESSAGE * p, struct svc_stat * svc, u64 t0)
 {
+	struct hd_req * r;
+
+	for (r = hd_queue; r < hd_queue + NR_HD_REQS; r++)
+		if (!r->busy)
+			break;
+	assert(r < hd_queue + NR_HD_REQS); /* task_hd() takes no more */
 
 	/*Step1. 判断请求是否合法，并计算要读/写的扇区号*/
 	int drive = DRV_OF_DEV(p->DEVICE);
 
 	u64 pos = p->POSITION;
-	assert((pos >> SECTOR_SIZE_SHIFT) < (1 << 31));     //最大不超过2^30KB
-
-
 	assert((pos & 0x1FF) == 0);        //只能按扇区读写
 
-	u32 sect_nr = (u32)(pos >> SECTOR_SIZE_SHIFT);              //位于当前逻辑分区的第几个扇区
+	u64 sect_nr = pos >> SECTOR_SIZE_SHIFT;                     //位于当前逻辑分区的第几个扇区
 	int logidx = (p->DEVICE - MINOR_hd1a) % NR_SUB_PER_DRIVE;       //第几个逻辑分区
 	sect_nr += p->DEVICE < MAX_PRIM ?
 		hd_info[drive].primary[p->DEVICE].base :                   //再加上当前逻辑分区的首扇区号
 		hd_info[drive].logical[logidx].base;
 
+	/**
+	 * With a grant, PROC_NR is the granter and BUF the offset in the
+	 * window, @see kernel/grant.c
+	 */
+	void * la = p->GRANT == NO_GRANT ?
+		va2la(p->PROC_NR, p->BUF) :
+		grant_la(p->PROC_NR, p->GRANT, TASK_HD, (int)p->BUF, p->CNT,
+			 p->type == DEV_READ ? GRANT_WRITE : GRANT_READ);
+	assert(la);
+
+	assert(hd_info[drive].lba48 || sect_nr < (1 << 28));       //不支持LBA48时最大2^28个扇区
+
+	r->msg		= *p;
+	r->drive	= drive;
+	r->sect_nr	= sect_nr;
+	r->nr_sects	= (p->CNT + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	r->la		= la;
+	r->seq		= hd_seq++;
+	r->passed	= 0;
+	r->svc		= svc;
+	r->t0		= t0;
+
     /*判断是否是单个扇区并且在缓冲区内，如果是，就直接读缓冲区*/
-	if(p->CNT<=SECTOR_SIZE){
-		if(p->type==DEV_READ){
-			struct buf_node* node=rwexist(sect_nr);
-			if(node){
-				phys_copy((void*)va2la(p->PROC_NR, p->BUF), (void*)va2la(TASK_HD, node->secbuf),SECTOR_SIZE);
-				return;
-			}
+	/* unless a write queued before it is to change the sector */
+	if(p->CNT<=SECTOR_SIZE && p->type==DEV_READ && !hd_blocked(r)){
+		struct buf_node* node=rwexist((u32)sect_nr);
+		if(node){
+			phys_copy(la, (void*)va2la(TASK_HD, node->secbuf),SECTOR_SIZE);
+			return 0;
 		}
 	}
 
-	/*Step2. 建立一个命令结构体，包括数据长度，数据位置，命令类型等内容，并向端口写入*/
-	struct hd_cmd cmd;
-	cmd.features	= 0;
-	cmd.count	= (p->CNT + SECTOR_SIZE - 1) / SECTOR_SIZE;               //消息中的数据占用几个扇区
-	cmd.lba_low	= sect_nr & 0xFF;                                         //扇区号的低中高8位
-	cmd.lba_mid	= (sect_nr >>  8) & 0xFF;
-	cmd.lba_high	= (sect_nr >> 16) & 0xFF;
-	cmd.device	= MAKE_DEVICE_REG(1, drive, (sect_nr >> 24) & 0xF);           //lba寻址，0号驱动(主设备)
-	cmd.command	= (p->type == DEV_READ) ? ATA_READ : ATA_WRITE;                //读/写指令
-	hd_cmd_out(&cmd);                                                          //将内容写到端口寄存器
-
-
-	/*Step3. 获取消息中数据的物理地址，根据命令类型，和数据长度向端口读/写数据*/
-	int bytes_left = p->CNT;                                                  //剩余要写的字节数
-	void * la = (void*)va2la(p->PROC_NR, p->BUF);                             //将消息中buf的虚拟地址转换为物理地址
-
-	if(p->type==DEV_WRITE){
-		invalid_buf(sect_nr, sect_nr+(p->CNT / SECTOR_SIZE));
-	}
-
-	u32 idx=sect_nr;
-	while (bytes_left) {
-		int bytes = min(SECTOR_SIZE, bytes_left);                          //每次读写最多一个扇区，512字节
-		if (p->type == DEV_READ) {                                          //读指令
-			interrupt_wait();                                               //等待硬件处理完成后通知，然后才能继续执行
-			port_read(REG_DATA, hdbuf, SECTOR_SIZE);                        //从data寄存器处读出512个字节的数据到hdbuf
-			phys_copy(la, (void*)va2la(TASK_HD, hdbuf), bytes);             //将hdbuf地址转换为物理地址，然后将hdbuf内容复制到消息中的buf处
-
-			struct buf_node* node=get_empty_buf(idx);
-			phys_copy((void*)va2la(TASK_HD, node->secbuf), la, bytes);        //将读取的扇区内容写入缓冲区
+	r->busy = 1;
+	hd_nr_pending++;
+
+	return 1;
+}
+
+/*****************************************************************************
+ *                                hd_blocked
+ *****************************************************************************/
+/**
+ * <Ring 1> A request must not go before an earlier one on the same sectors,
+ * if either of them writes.
+ * 
+ * @param r  The request.
+ * 
+ * @return Nonzero if there is such an earlier request pending.
+ *****************************************************************************/
+PRIVATE int hd_blocked(struct hd_req * r)
+{
+	struct hd_req * q;
+
+	for (q = hd_queue; q < hd_queue + NR_HD_REQS; q++) {
+		if (!q->busy || q == r || (int)(q->seq - r->seq) > 0 ||
+		    q->drive != r->drive)
+			continue;
+		if (q->msg.type == DEV_READ && r->msg.type == DEV_READ)
+			continue;
+		if (q->sect_nr < r->sect_nr + r->nr_sects &&
+		    r->sect_nr < q->sect_nr + q->nr_sects)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                hd_pick
+ *****************************************************************************/
+/**
+ * <Ring 1> Choose the next request by C-LOOK: the nearest one at or beyond
+ * the head, going up, or the lowest one when there is none beyond. A
+ * request passed over HD_MAX_PASS times goes first, the oldest of them.
+ * 
+ * @return The request.
+ *****************************************************************************/
+PRIVATE struct hd_req * hd_pick()
+{
+	struct hd_req * r;
+	struct hd_req * next = 0;	/* at or beyond the head */
+	struct hd_req * lowest = 0;
+	struct hd_req * starved = 0;
+
+	for (r = hd_queue; r < hd_queue + NR_HD_REQS; r++) {
+		if (!r->busy || hd_blocked(r))
+			continue;
+		if (r->passed >= HD_MAX_PASS &&
+		    (!starved || (int)(r->seq - starved->seq) < 0))
+			starved = r;
+		if (r->sect_nr >= hd_head &&
+		    (!next || r->sect_nr < next->sect_nr))
+			next = r;
+		if (!lowest || r->sect_nr < lowest->sect_nr)
+			lowest = r;
+	}
+
+	/* the oldest request is never blocked */
+	assert(lowest);
+
+	return starved ? starved : next ? next : lowest;
+}
+
+/*****************************************************************************
+ *                                hd_merge
+ *****************************************************************************/
+/**
+ * <Ring 1> Find the requests which go on right after a request, of the same
+ * kind, so that one command does them all.
+ * 
+ * @param r      The request.
+ * @param parts  To accept the requests, r first, in the order of sectors.
+ * 
+ * @return How many requests are in parts[].
+ *****************************************************************************/
+PRIVATE int hd_merge(struct hd_req * r, struct hd_req ** parts)
+{
+	struct hd_info * hdi = &hd_info[r->drive];
+	int max_sects = hdi->lba48 ? MAX_IO_SECTS_EXT : MAX_IO_BYTES;
+	int nr = 0;
+	int nr_sects = r->nr_sects;
+
+	parts[nr++] = r;
+
+	/* only whole sectors can be merged */
+	while (parts[nr - 1]->msg.CNT % SECTOR_SIZE == 0) {
+		struct hd_req * last = parts[nr - 1];
+		struct hd_req * q;
+
+		for (q = hd_queue; q < hd_queue + NR_HD_REQS; q++)
+			if (q->busy && q->drive == r->drive &&
+			    q->msg.type == r->msg.type &&
+			    q->sect_nr == last->sect_nr + last->nr_sects &&
+			    nr_sects + q->nr_sects <= max_sects &&
+			    !hd_blocked(q))
+				break;
+		if (q == hd_queue + NR_HD_REQS)
+			break;
+
+		parts[nr++] = q;
+		nr_sects += q->nr_sects;
+	}
+
+	return nr;
+}
+
+/*****************************************************************************
+ *                                hd_dispatch
+ *****************************************************************************/
+/**
+ * <Ring 1> Do the next request, with those merged into it, and reply to
+ * each of the requesters.
+ * 
+ *****************************************************************************/
+PRIVATE void hd_dispatch()
+{
+	struct hd_req * parts[NR_HD_REQS];
+	struct hd_req * r = hd_pick();
+	int nr = hd_merge(r, parts);
+	int i;
+
+	int ok = hd_rdwt(parts, nr);
+
+	for (i = 0; i < nr; i++) {
+		parts[i]->busy = 0;
+		if (!ok)	/* nothing is told to be transferred */
+			parts[i]->msg.CNT = 0;
+	}
+	hd_nr_pending -= nr;
+	hd_head = parts[nr - 1]->sect_nr + parts[nr - 1]->nr_sects;
+
+	for (r = hd_queue; r < hd_queue + NR_HD_REQS; r++)
+		if (r->busy)
+			r->passed++;
+
+	/* the completions, TAG and all, @see fs_drv_submit() */
+	for (i = 0; i < nr; i++) {
+		svc_end(parts[i]->svc, parts[i]->t0);
+		send_async(parts[i]->msg.source, &parts[i]->msg);
+	}
+}
+
+/*****************************************************************************
+ *                                cur_peek
+ *****************************************************************************/
+/**
+ * <Ring 1> Where a transfer over several requests' buffers is.
+ * 
+ * @param c     The cursor.
+ * @param la    To accept the linear addr.
+ * @param left  To accept how many bytes are left in this buffer.
+ *****************************************************************************/
+PRIVATE void cur_peek(struct hd_cursor * c, void ** la, int * left)
+{
+	struct hd_req * r = c->parts[c->i];
+
+	*la = r->la + c->off;
+	*left = r->msg.CNT - c->off;
+}
+
+/*****************************************************************************
+ *                                cur_advance
+ *****************************************************************************/
+/**
+ * <Ring 1> Move a cursor on, at most to the end of the current buffer.
+ * 
+ * @param c  The cursor.
+ * @param n  How many bytes.
+ *****************************************************************************/
+PRIVATE void cur_advance(struct hd_cursor * c, int n)
+{
+	c->off += n;
+	if (c->off == c->parts[c->i]->msg.CNT) {
+		c->i++;
+		c->off = 0;
+	}
+}
+
+/*****************************************************************************
+ *                                hd_rdwt
+ *****************************************************************************/
+/**
+ * <Ring 1> Read or write the sectors of some requests which go on one after
+ * another, @see hd_merge().
+ * 
+ * @param parts  The requests.
+ * @param nr     How many.
+ * 
+ * @return Nonzero if done, zero if the drive did not get ready in time.
+ *****************************************************************************/
+PRIVATE int hd_rdwt(struct hd_req ** parts, int nr)
+{
+	int type = parts[0]->msg.type;
+	int drive = parts[0]->drive;
+	int bytes_left = 0;                                                       //剩余要写的字节数
+	int dma_ok = 1;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		bytes_left += parts[i]->msg.CNT;
+		/* bus master DMA takes whole sectors at even addrs only */
+		if (parts[i]->msg.CNT % SECTOR_SIZE || ((u32)parts[i]->la & 1))
+			dma_ok = 0;
+		if (type == DEV_WRITE)
+			invalid_buf((u32)parts[i]->sect_nr,
+				    (u32)(parts[i]->sect_nr +
+					  parts[i]->msg.CNT / SECTOR_SIZE));
+	}
+
+	/*Step2. 建立命令结构体并向端口写入，一条命令最多MAX_IO_BYTES个扇区(LBA48为MAX_IO_SECTS_EXT个)*/
+	/*Step3. 根据命令类型向端口读/写数据，每次中断读/写一块(mult_sects个扇区)*/
+	struct hd_info * hdi = &hd_info[drive];
+	int max_sects = hdi->lba48 ? MAX_IO_SECTS_EXT : MAX_IO_BYTES;
+	int blk = hdi->mult_sects ? hdi->mult_sects : 1;   /* sectors per interrupt */
+	struct hd_cursor cur = {parts, 0, 0};
+
+	u64 idx=parts[0]->sect_nr;
+	while (bytes_left > 0) {
+		int nr_sects = min(max_sects,
+				   (bytes_left + SECTOR_SIZE - 1) / SECTOR_SIZE);
+		int cmd_bytes = min(nr_sects * SECTOR_SIZE, bytes_left);
+
+		struct hd_cursor saved = cur;
+		if (dma_ok && hd_dma(type, drive, idx, &cur, cmd_bytes)) {
+			bytes_left -= cmd_bytes;
+			idx += nr_sects;
+			continue;
 		}
-		else {                                                                //写指令
-			if (!waitfor(STATUS_DRQ, STATUS_DRQ, HD_TIMEOUT))                 //确认是否可写（状态空闲？）
-				panic("hd writing error.");
- 
-			port_write(REG_DATA, la, bytes);                                 //将bytes个字节的数据从消息中buf的物理地址la处写到data寄存器中
-			interrupt_wait();                                                //等待硬件处理完成
-
-			struct buf_node* node=get_empty_buf(idx);
-			phys_copy((void*)va2la(TASK_HD, node->secbuf), la, bytes);        //将写入的扇区内容写入缓冲区
+		cur = saved;
+
+		struct hd_cmd cmd;
+		hd_cmd_lba(&cmd, drive, idx, nr_sects);
+		if (type == DEV_READ && hdi->lba48)
+			cmd.command = hdi->mult_sects ? ATA_READ_MULTIPLE_EXT :
+							ATA_READ_EXT;
+		else if (type == DEV_READ)
+			cmd.command = hdi->mult_sects ? ATA_READ_MULTIPLE : ATA_READ;
+		else if (hdi->lba48)
+			cmd.command = hdi->mult_sects ? ATA_WRITE_MULTIPLE_EXT :
+							ATA_WRITE_EXT;
+		else
+			cmd.command = hdi->mult_sects ? ATA_WRITE_MULTIPLE : ATA_WRITE;
+		if (!hd_cmd_out(&cmd))
+			return 0;
+
+		if (type == DEV_WRITE &&
+		    !waitfor(STATUS_DRQ, STATUS_DRQ, HD_TIMEOUT)) {               //确认是否可写（状态空闲？）
+			printl("{HD} drive not ready for writing\n");
+			return 0;
+		}
+
+		int s;
+		for (s = 0; s < nr_sects; s += blk) {
+			int n = min(blk, nr_sects - s);            /* sectors of this block */
+			int bytes = min(n * SECTOR_SIZE, bytes_left);
+
+			if (type == DEV_READ)                                       //读指令
+				interrupt_wait();                                   //一次中断对应一块
+
+			bytes_left -= bytes;
+			while (bytes) {
+				void * la;
+				int k;
+				cur_peek(&cur, &la, &k);
+				k = min(k, bytes);
+				int whole = k & ~(SECTOR_SIZE - 1);
+
+				if (whole) {
+					/* whole sectors go right to/from the requester */
+					if (type == DEV_READ)
+						hd_data_in(drive, la, whole);
+					else
+						hd_data_out(drive, la, whole);
+					k = whole;
+				}
+				else if (type == DEV_READ) {
+					/* the partial sector at the very end */
+					hd_data_in(drive, hdbuf, SECTOR_SIZE);
+					phys_copy(la, (void*)va2la(TASK_HD, hdbuf), k);
+				}
+				else {
+					/* the drive takes whole sectors only */
+					memset(hdbuf, 0, SECTOR_SIZE);
+					phys_copy((void*)va2la(TASK_HD, hdbuf), la, k);
+					hd_data_out(drive, hdbuf, SECTOR_SIZE);
+				}
+
+				cur_advance(&cur, k);
+				bytes -= k;
+			}
+
+			if (type == DEV_WRITE)                                      //写指令
+				interrupt_wait();                                   //等待硬件处理完成
 		}
-		bytes_left -= SECTOR_SIZE;
-		la += SECTOR_SIZE;  
-		idx++;                                                 
+		idx += nr_sects;
 	}
+
+	/**
+	 * Only the small ones are put into the buffer, it serves single
+	 * sector reads, and a big transfer would only flush it.
+	 */
+	for (i = 0; i < nr; i++)                            //将读/写的扇区内容写入缓冲区
+		if (parts[i]->msg.CNT <= RWBUF_FILL_MAX * SECTOR_SIZE)
+			hd_fill_cache(parts[i]->sect_nr, parts[i]->la,
+				      parts[i]->msg.CNT);
+
+	return 1;
 }															
 
 
+/*****************************************************************************
+ *                                hd_fill_cache
+ *****************************************************************************/
+/**
+ * <Ring 1> Put the sectors just read or written into the buffer.
+ * 
+ * @param sect_nr  The first sector.
+ * @param la       Where the data are.
+ * @param bytes    How many bytes, the last sector may be partial.
+ *****************************************************************************/
+PRIVATE void hd_fill_cache(u64 sect_nr, void * la, int bytes)
+{
+	int i;
+	for (i = 0; i * SECTOR_SIZE < bytes; i++) {               //将读/写的扇区内容写入缓冲区
+		struct buf_node* node=get_empty_buf((u32)(sect_nr + i));
+		phys_copy((void*)va2la(TASK_HD, node->secbuf),
+			  la + i * SECTOR_SIZE,
+			  min(SECTOR_SIZE, bytes - i * SECTOR_SIZE));
+	}
+}
+
+/*****************************************************************************
+ *                                hd_dma
+ *****************************************************************************/
+/**
+ * <Ring 1> Read or write sectors by bus master DMA, completion is told by
+ * the disk interrupt as with PIO.
+ *
+ * If the controller reports an error, DMA is given up for the drive and
+ * the caller redoes the transfer by PIO. So it does if the drive is busy,
+ * which PIO will then report.
+ * 
+ * @param type     DEV_READ or DEV_WRITE.
+ * @param drive    Drive nr.
+ * @param sect_nr  The first sector (LBA).
+ * @param c        Where the buffers are, moved on as the PRDs are made.
+ * @param bytes    A multiple of SECTOR_SIZE, MAX_IO_BYTES sectors at most,
+ *                 or MAX_IO_SECTS_EXT with LBA48. The buffers must be at
+ *                 even addrs.
+ * 
+ * @return Nonzero if done, zero if it must be done by PIO.
+ *****************************************************************************/
+PRIVATE int hd_dma(int type, int drive, u64 sect_nr, struct hd_cursor * c,
+		  int bytes)
+{
+	if (!hd_info[drive].dma)
+		return 0;
+
+	/* the memory is mapped one to one, la == pa, @see SetupPaging in loader */
+	struct prd * prd = prd_table;
+	int left = bytes;
+	while (left) {
+		void * la;
+		int n;
+		cur_peek(c, &la, &n);
+		u32 addr = (u32)la;
+		n = min(min(n, left), 0x10000 - (addr & 0xFFFF));
+		prd->base = addr;
+		prd->cnt = n & 0xFFFF;
+		prd->flags = 0;
+		cur_advance(c, n);
+		left -= n;
+		prd++;
+	}
+	prd[-1].flags = PRD_EOT;
+
+	u8 dir = type == DEV_READ ? BM_CMD_READ : 0;
+	out_dword(bmide_base + BM_PRDT, (u32)va2la(TASK_HD, prd_table));
+	out_byte(bmide_base + BM_CMD, dir);
+	out_byte(bmide_base + BM_STATUS, BM_ST_ERR | BM_ST_INT); /* clear */
+
+	struct hd_cmd cmd;
+	hd_cmd_lba(&cmd, drive, sect_nr, bytes / SECTOR_SIZE);
+	if (hd_info[drive].lba48)
+		cmd.command = type == DEV_READ ? ATA_READ_DMA_EXT :
+						 ATA_WRITE_DMA_EXT;
+	else
+		cmd.command = type == DEV_READ ? ATA_READ_DMA : ATA_WRITE_DMA;
+	if (!hd_cmd_out(&cmd))
+		return 0;
+
+	out_byte(bmide_base + BM_CMD, dir | BM_CMD_START);
+	interrupt_wait();
+
+	u8 st = in_byte(bmide_base + BM_STATUS);
+	out_byte(bmide_base + BM_CMD, dir);			/* stop */
+	out_byte(bmide_base + BM_STATUS, BM_ST_ERR | BM_ST_INT);
+
+	if ((st & BM_ST_ERR) || (hd_status & STATUS_ERR)) {
+		printl("{HD} DMA error, falling back to PIO\n");
+		hd_info[drive].dma = 0;
+		return 0;
+	}
+
+	return 1;
+}
+
+/*****************************************************************************
+ *                                find_bmide
+ *****************************************************************************/
+/**
+ * <Ring 1> Look for an IDE controller on PCI bus 0 which can be bus master,
+ * e.g. the PIIX, and get its BMIDE base.
+ * 
+ *****************************************************************************/
+PRIVATE void find_bmide()
+{
+	u32 dev;
+
+	bmide_base = 0;
+	assert(NR_PRDS * sizeof(struct prd) <= PRD_AREA_SIZE);
+	prd_table = (struct prd *)(((u32)prd_area + PRD_AREA_SIZE - 1) &
+				   ~(PRD_AREA_SIZE - 1));
+
+	for (dev = 0; dev < 32 * 8; dev++) {	/* device nr and function nr */
+		u32 class = pci_read(dev, PCI_CLASS);
+		if (class == 0xFFFFFFFF || (class >> 16) != PCI_CLASS_IDE)
+			continue;
+
+		u32 bar4 = pci_read(dev, PCI_BAR4);
+		if (!(bar4 & 1) || !(bar4 & 0xFFFC))	/* must be I/O space */
+			continue;
+
+		u32 cmd = pci_read(dev, PCI_COMMAND) & 0xFFFF;
+		pci_write(dev, PCI_COMMAND, cmd | PCI_CMD_IO | PCI_CMD_MASTER);
+
+		bmide_base = bar4 & 0xFFFC;
+		printl("{HD} bus master IDE: PCI 0:%d.%d, port 0x%x\n",
+		       dev >> 3, dev & 7, bmide_base);
+		return;
+	}
+}
+
+/*****************************************************************************
+ *                                pci_read
+ *****************************************************************************/
+/**
+ * <Ring 1> Read a dword from the configuration space of a PCI function on
+ * bus 0, by configuration mechanism #1.
+ * 
+ * @param dev  Device nr << 3 | function nr.
+ * @param reg  Register offset, a multiple of 4.
+ * 
+ * @return The dword, 0xFFFFFFFF if there is no such function.
+ *****************************************************************************/
+PRIVATE u32 pci_read(u32 dev, int reg)
+{
+	out_dword(PCI_CONFIG_ADDR, 0x80000000 | (dev << 8) | reg);
+	return in_dword(PCI_CONFIG_DATA);
+}
+
+/*****************************************************************************
+ *                                pci_write
+ *****************************************************************************/
+/**
+ * <Ring 1> Write a dword into the configuration space, @see pci_read().
+ * 
+ * @param dev  Device nr << 3 | function nr.
+ * @param reg  Register offset, a multiple of 4.
+ * @param val  The dword.
+ *****************************************************************************/
+PRIVATE void pci_write(u32 dev, int reg, u32 val)
+{
+	out_dword(PCI_CONFIG_ADDR, 0x80000000 | (dev << 8) | reg);
+	out_dword(PCI_CONFIG_DATA, val);
+}
+
+/*****************************************************************************
+ *                                hd_data_in
+ *****************************************************************************/
+/**
+ * <Ring 1> Read whole sectors from the data port, 32 bits at a time if the
+ * drive allows.
+ * 
+ * @param drive  Drive nr.
+ * @param buf    Where the data go.
+ * @param bytes  A multiple of SECTOR_SIZE.
+ *****************************************************************************/
+PRIVATE void hd_data_in(int drive, void * buf, int bytes)
+{
+	if (hd_info[drive].io32)
+		port_read32(REG_DATA, buf, bytes);
+	else
+		port_read(REG_DATA, buf, bytes);
+}
+
+/*****************************************************************************
+ *                                hd_data_out
+ *****************************************************************************/
+/**
+ * <Ring 1> Write whole sectors to the data port, @see hd_data_in().
+ * 
+ * @param drive  Drive nr.
+ * @param buf    Where the data are.
+ * @param bytes  A multiple of SECTOR_SIZE.
+ *****************************************************************************/
+PRIVATE void hd_data_out(int drive, void * buf, int bytes)
+{
+	if (hd_info[drive].io32)
+		port_write32(REG_DATA, buf, bytes);
+	else
+		port_write(REG_DATA, buf, bytes);
+}
+
+
 /*****************************************************************************
  *                                hd_ioctl
  *****************************************************************************/
@@ -289,16 +882,12 @@ PRIVATE void hd_ioctl(MESSAGE * p)
 PRIVATE void get_part_table(int drive, int sect_nr, struct part_ent * entry)
 {
 	struct hd_cmd cmd;
-	cmd.features	= 0;
-	cmd.count	= 1;
-	cmd.lba_low	= sect_nr & 0xFF;
-	cmd.lba_mid	= (sect_nr >>  8) & 0xFF;
-	cmd.lba_high	= (sect_nr >> 16) & 0xFF;
-	cmd.device	= MAKE_DEVICE_REG(1, /* LBA mode*/
-					  drive,
-					  (sect_nr >> 24) & 0xF);
+	hd_cmd_lba(&cmd, drive, sect_nr, 1);
 	cmd.command	= ATA_READ;
-	hd_cmd_out(&cmd);
+	if (!hd_cmd_out(&cmd)) {	/* taken as no partitions */
+		memset(entry, 0, sizeof(struct part_ent) * NR_PART_PER_DRIVE);
+		return;
+	}
 	interrupt_wait();
 
 	port_read(REG_DATA, hdbuf, SECTOR_SIZE);
@@ -385,10 +974,10 @@ PRIVATE void print_hdinfo(struct hd_info * hdi)
 		printl("%sPART_%d: base %d(0x%x), size %d(0x%x) (in sector)\n",
 		       i == 0 ? " " : "     ",
 		       i,
-		       hdi->primary[i].base,
-		       hdi->primary[i].base,
-		       hdi->primary[i].size,
-		       hdi->primary[i].size);
+		       (u32)hdi->primary[i].base,
+		       (u32)hdi->primary[i].base,
+		       (u32)hdi->primary[i].size,
+		       (u32)hdi->primary[i].size);
 	}
 	for (i = 0; i < NR_SUB_PER_DRIVE; i++) {
 		if (hdi->logical[i].size == 0)
@@ -396,10 +985,10 @@ PRIVATE void print_hdinfo(struct hd_info * hdi)
 		printl("         "
 		       "%d: base %d(0x%x), size %d(0x%x) (in sector)\n",
 		       i,
-		       hdi->logical[i].base,
-		       hdi->logical[i].base,
-		       hdi->logical[i].size,
-		       hdi->logical[i].size);
+		       (u32)hdi->logical[i].base,
+		       (u32)hdi->logical[i].base,
+		       (u32)hdi->logical[i].size,
+		       (u32)hdi->logical[i].size);
 	}
 }
 
@@ -416,7 +1005,8 @@ PRIVATE void hd_identify(int drive)
 	struct hd_cmd cmd;
 	cmd.device  = MAKE_DEVICE_REG(0, drive, 0);
 	cmd.command = ATA_IDENTIFY;
-	hd_cmd_out(&cmd);
+	if (!hd_cmd_out(&cmd))		/* what we knew is kept */
+		return;
 	interrupt_wait();
 	port_read(REG_DATA, hdbuf, SECTOR_SIZE);
 
@@ -425,8 +1015,59 @@ PRIVATE void hd_identify(int drive)
 	u16* hdinfo = (u16*)hdbuf;
 
 	hd_info[drive].primary[0].base = 0;
-	/* Total Nr of User Addressable Sectors */
-	hd_info[drive].primary[0].size = ((int)hdinfo[61] << 16) + hdinfo[60];
+	/* 48-bit Address feature set supported */
+	hd_info[drive].lba48 = hdinfo[83] & 0x0400;
+	/* Total Nr of User Addressable Sectors, words 100~103 for LBA48 */
+	if (hd_info[drive].lba48)
+		hd_info[drive].primary[0].size = ((u64)hdinfo[103] << 48) +
+						 ((u64)hdinfo[102] << 32) +
+						 ((u64)hdinfo[101] << 16) +
+						 hdinfo[100];
+	else
+		hd_info[drive].primary[0].size = ((int)hdinfo[61] << 16) +
+						 hdinfo[60];
+
+	/* Doubleword I/O supported */
+	hd_info[drive].io32 = hdinfo[48] & 1;
+
+	/* DMA supported, and there is a bus master to do it */
+	hd_info[drive].dma = bmide_base && (hdinfo[49] & 0x0100);
+
+	hd_set_multiple(drive, hdinfo);
+}
+
+/*****************************************************************************
+ *                                hd_set_multiple
+ *****************************************************************************/
+/**
+ * <Ring 1> Have the drive move a block of sectors per interrupt for READ
+ * MULTIPLE and WRITE MULTIPLE, as many as it allows but MAX_MULT_SECTS.
+ * 
+ * @param drive   Drive Nr.
+ * @param hdinfo  What ATA_IDENTIFY has got.
+ *****************************************************************************/
+PRIVATE void hd_set_multiple(int drive, u16* hdinfo)
+{
+	/* Max nr of sectors per block, bits 7:0 of word 47 */
+	int max_sects = min(hdinfo[47] & 0xFF, MAX_MULT_SECTS);
+	int n = 1;
+
+	hd_info[drive].mult_sects = 0;
+	if (max_sects == 0)
+		return;
+
+	while (n * 2 <= max_sects)	/* a power of 2, for the old drives */
+		n *= 2;
+
+	struct hd_cmd cmd;
+	hd_cmd_lba(&cmd, drive, 0, n);
+	cmd.command	= ATA_SET_MULTIPLE;
+	if (!hd_cmd_out(&cmd))		/* single sector then */
+		return;
+	interrupt_wait();
+
+	if (!(hd_status & STATUS_ERR))
+		hd_info[drive].mult_sects = n;
 }
 
 /*****************************************************************************
@@ -467,8 +1108,42 @@ PRIVATE void print_identify_info(u16* hdinfo)
 	printl("LBA48 supported: %s\n",
 	       (cmd_set_supported & 0x0400) ? "Yes" : "No");
 
-	int sectors = ((int)hdinfo[61] << 16) + hdinfo[60];
-	printl("HD size: %dMB\n", sectors * 512 / 1000000);
+	printl("Multiple sectors: %d, 32-bit I/O: %s\n",
+	       hdinfo[47] & 0xFF, (hdinfo[48] & 1) ? "Yes" : "No");
+
+	/* words 100~103 with LBA48, as hd_identify() takes */
+	u64 sectors = (cmd_set_supported & 0x0400) ?
+		((u64)hdinfo[103] << 48) + ((u64)hdinfo[102] << 32) +
+		((u64)hdinfo[101] << 16) + hdinfo[100] :
+		((u64)hdinfo[61] << 16) + hdinfo[60];
+	/* 2048 sectors a MB, shifted as there is no 64-bit division */
+	printl("HD size: %dMB\n", (int)(sectors >> 11));
+}
+
+/*****************************************************************************
+ *                                hd_cmd_lba
+ *****************************************************************************/
+/**
+ * <Ring 1> Fill in the sector count and the address of a command, in LBA
+ * mode. The command code is left to the caller.
+ * 
+ * @param cmd      The command struct ptr.
+ * @param drive    Drive Nr.
+ * @param sect_nr  The first sector, 48 bits for the LBA48 commands, else 28.
+ * @param count    How many sectors, 65536 (LBA48) or 256 at most.
+ *****************************************************************************/
+PRIVATE void hd_cmd_lba(struct hd_cmd * cmd, int drive, u64 sect_nr, int count)
+{
+	cmd->features	  = 0;
+	cmd->count	  = count;	/* 65536 and 256 go as 0 */
+	cmd->lba_low	  = sect_nr & 0xFF;
+	cmd->lba_mid	  = (sect_nr >>  8) & 0xFF;
+	cmd->lba_high	  = (sect_nr >> 16) & 0xFF;
+	cmd->lba_low_exp  = (sect_nr >> 24) & 0xFF;
+	cmd->lba_mid_exp  = (sect_nr >> 32) & 0xFF;
+	cmd->lba_high_exp = (sect_nr >> 40) & 0xFF;
+	/* bits 24~27 are in DEVICE too, LBA48 commands ignore them */
+	cmd->device	  = MAKE_DEVICE_REG(1, drive, (sect_nr >> 24) & 0xF);
 }
 
 /*****************************************************************************
@@ -478,19 +1153,34 @@ PRIVATE void print_identify_info(u16* hdinfo)
  * <Ring 1> Output a command to HD controller.
  * 
  * @param cmd  The command struct ptr.
+ * 
+ * @return Nonzero if success, zero if the drive stays busy, in which case
+ *         nothing is output.
  *****************************************************************************/
-PRIVATE void hd_cmd_out(struct hd_cmd* cmd)
+PRIVATE int hd_cmd_out(struct hd_cmd* cmd)
 {
 	/**
 	 * For all commands, the host must first check if BSY=1,
 	 * and should proceed no further unless and until BSY=0
 	 */
-	if (!waitfor(STATUS_BSY, 0, HD_TIMEOUT))
-		panic("hd error.");
+	if (!waitfor(STATUS_BSY, 0, HD_TIMEOUT)) {
+		printl("{HD} drive busy, command 0x%x not sent\n",
+		       cmd->command);
+		return 0;
+	}
 
 	/* Activate the Interrupt Enable (nIEN) bit */
 	out_byte(REG_DEV_CTRL, 0);
-	/* Load required parameters in the Command Block Registers */
+	/**
+	 * Load required parameters in the Command Block Registers. Each one
+	 * is a FIFO of two bytes: an LBA48 command takes the older byte as
+	 * the high one, a 28-bit command the newer byte only.
+	 */
+	out_byte(REG_FEATURES, 0);
+	out_byte(REG_NSECTOR,  cmd->count >> 8);
+	out_byte(REG_LBA_LOW,  cmd->lba_low_exp);
+	out_byte(REG_LBA_MID,  cmd->lba_mid_exp);
+	out_byte(REG_LBA_HIGH, cmd->lba_high_exp);
 	out_byte(REG_FEATURES, cmd->features);
 	out_byte(REG_NSECTOR,  cmd->count);
 	out_byte(REG_LBA_LOW,  cmd->lba_low);
@@ -499,6 +1189,8 @@ PRIVATE void hd_cmd_out(struct hd_cmd* cmd)
 	out_byte(REG_DEVICE,   cmd->device);
 	/* Write the command code to the Command Register */
 	out_byte(REG_CMD,     cmd->command);
+
+	return 1;
 }
 
 /*****************************************************************************
@@ -506,19 +1198,56 @@ PRIVATE void hd_cmd_out(struct hd_cmd* cmd)
  *****************************************************************************/
 /**
  * <Ring 1> Wait until a disk interrupt occurs.
+ *
+ * A HARD_INT may stand for several interrupts (INT_CNT), the ones not
+ * waited for yet are kept in hd_ints, so no interrupt is waited for twice.
+ * An interrupt which never comes is reported instead of hanging the driver.
+ *
+ * While the disk is busy, new DEV_READ and DEV_WRITE are taken into the
+ * queue and SVC_STAT is served, so that the clients need not wait for the
+ * command to finish before they send more, @see hd_serve(). Any other msg,
+ * which would touch the disk itself, is kept in hd_ctl_msg for task_hd()
+ * to serve later; no more msgs are taken until then.
  * 
  *****************************************************************************/
 PRIVATE void interrupt_wait()
 {
+	if (hd_ints > 0) {
+		hd_ints--;
+		return;
+	}
+
 	MESSAGE msg;
-	send_recv(RECEIVE, INTERRUPT, &msg);
+	while (1) {
+		int src = hd_nr_pending < NR_HD_REQS && !hd_ctl_pending ?
+			ANY : INTERRUPT;
+		if (recv_timed(src, &msg, HD_TIMEOUT * HZ / 1000) == TIMED_OUT)
+			panic("hd interrupt timeout.");
+		if (msg.source == INTERRUPT)
+			break;
+
+		switch (msg.type) {
+		case DEV_READ:
+		case DEV_WRITE:
+		case SVC_STAT:
+			hd_serve(&msg);
+			break;
+		default:
+			hd_ctl_msg = msg;
+			hd_ctl_pending = 1;
+			break;
+		}
+	}
+	hd_ints = msg.INT_CNT - 1;
 }
 
 /*****************************************************************************
  *                                waitfor
  *****************************************************************************/
 /**
- * <Ring 1> Wait for a certain status.
+ * <Ring 1> Wait for a certain status. The status is checked once a tick and
+ * whenever the disk interrupts, the driver sleeps in recv_timed() in
+ * between. The interrupts got here are kept for interrupt_wait().
  * 
  * @param mask    Status mask.
  * @param val     Required status.
@@ -528,13 +1257,19 @@ PRIVATE void interrupt_wait()
  *****************************************************************************/
 PRIVATE int waitfor(int mask, int val, int timeout)
 {
-	int t = get_ticks();
+	/* the first sleep may be shorter than a tick */
+	int n = timeout * HZ / 1000 + 1;
 
-	while(((get_ticks() - t) * 1000 / HZ) < timeout)
+	while (1) {
 		if ((in_byte(REG_STATUS) & mask) == val)
 			return 1;
+		if (n-- == 0)
+			return 0;
 
-	return 0;
+		MESSAGE msg;
+		if (recv_timed(INTERRUPT, &msg, 1) != TIMED_OUT)
+			hd_ints += msg.INT_CNT;
+	}
 }
 
 /*****************************************************************************
@@ -555,117 +1290,140 @@ PUBLIC void hd_handler(int irq)
 	 */
 	hd_status = in_byte(REG_STATUS);
 
-	inform_int(TASK_HD);
+	inform_int(TASK_HD, irq);
 }
 
 
-PRIVATE void init_rwbuf()                          //初始化缓存区
+/*****************************************************************************
+ *                                init_rwbuf
+ *****************************************************************************/
+/**
+ * <Ring 1> Empty the sector buffer, all the nodes go to the free list.
+ * 
+ *****************************************************************************/
+PRIVATE void init_rwbuf()
 {
-	// for(int i=0;i<RWBUF_SIZE;i++){
-	// 	rwbuff[i].valid=0;
-	// }
+	int i;
 
+	rwbuf.first_node = 0;
+	rwbuf.last_node = 0;
+	rwbuf.node_nr = 0;
 
-	rwbuf.first_node=0;
-	rwbuf.last_node=0;
-	rwbuf.node_nr=0;
+	rwbuf_free = 0;
+	for (i = 0; i < RWBUF_SIZE; i++) {
+		rwbuf_nodes[i].next_node = rwbuf_free;
+		rwbuf_free = &rwbuf_nodes[i];
+	}
 }
 
-PRIVATE struct buf_node* rwexist(u32 sec_nr){                   //扇区是否在缓存区内,并移动节点
-	// for(int i=0;i<RWBUF_SIZE;i++)
-	// {
-	// 	if(rwbuff[i].valid==1&&rwbuff[i].sec_nr==sec_nr) return i;
-	// }
-	// return -1;
-
+/*****************************************************************************
+ *                                rwexist
+ *****************************************************************************/
+/**
+ * <Ring 1> Look for a sector in the buffer. The node found is moved to the
+ * end of the list, so that the first one is always the least recently used.
+ * 
+ * @param sec_nr  The sector.
+ * 
+ * @return The node, 0 if it is not in the buffer.
+ *****************************************************************************/
+PRIVATE struct buf_node* rwexist(u32 sec_nr)
+{
+	struct buf_node* prev = 0;
+	struct buf_node* node;
 
-	struct buf_node* node=rwbuf.first_node;
-	if(node->sec_nr==sec_nr){                      //先判断第一个结点
-		rwbuf.last_node->next_node=node;
-		rwbuf.last_node=node;
-		rwbuf.last_node->next_node=0;
-		rwbuf.first_node=rwbuf.first_node->next_node;
-		return rwbuf.last_node;
-	}
-	for(int i=1;i<rwbuf.node_nr;i++)
-	{
-		if(node->next_node->sec_nr==sec_nr){
-			rwbuf.last_node->next_node=node->next_node;
-			rwbuf.last_node=node->next_node;
-			rwbuf.last_node->next_node=0;
-			node->next_node=node->next_node->next_node;
+	for (node = rwbuf.first_node; node; prev = node, node = node->next_node)
+		if (node->sec_nr == sec_nr)
+			break;
+	if (!node || node == rwbuf.last_node)
+		return node;
 
-			return rwbuf.last_node;
-		}
-		else node=node->next_node;
-	}
-	return 0;
-} 
+	/* unlink it ... */
+	if (prev)
+		prev->next_node = node->next_node;
+	else
+		rwbuf.first_node = node->next_node;
 
+	/* ... and append it */
+	node->next_node = 0;
+	rwbuf.last_node->next_node = node;
+	rwbuf.last_node = node;
 
+	return node;
+}
 
-PRIVATE struct buf_node* get_empty_buf(u32 idx)                       //分配缓冲区
+/*****************************************************************************
+ *                                get_empty_buf
+ *****************************************************************************/
+/**
+ * <Ring 1> Get a node for a sector, the one already holding it if any, else
+ * a free one, else the least recently used one.
+ * 
+ * @param idx  The sector.
+ * 
+ * @return The node, at the end of the list. Its data are to be filled.
+ *****************************************************************************/
+PRIVATE struct buf_node* get_empty_buf(u32 idx)
 {
-	// for(int i=0;i<RWBUF_SIZE;i++)
-	// {
-	// 	if(rwbuff[i].valid==0){ 
-	// 		rwbuff[i].valid=1;
-	// 		rwbuff[i].sec_nr=idx;
-	// 		return i;
-	// 		}
-	// }
-	// rwbuff[0].sec_nr=idx;
-	// return 0;
+	struct buf_node* node = rwexist(idx);
+	if (node)
+		return node;
 
-
-	struct buf_node* node;
-	//node->valid=1;
-	node->sec_nr=idx;
-	node->next_node=0;
-	if(rwbuf.node_nr==0)                                //缓存为空
-	{
-		rwbuf.first_node=node;
-		rwbuf.last_node=node;
+	if (rwbuf_free) {
+		node = rwbuf_free;
+		rwbuf_free = node->next_node;
 		rwbuf.node_nr++;
-		return rwbuf.last_node;
 	}
-	else if(rwbuf.node_nr<RWBUF_SIZE){                    //缓存未满
-		rwbuf.last_node->next_node=node;
-		rwbuf.last_node=node;
-		rwbuf.node_nr++;
-		return rwbuf.last_node;
-	}
-	else if(rwbuf.node_nr==RWBUF_SIZE){                   //缓存已满，替换掉第一个
-		rwbuf.last_node->next_node=node;
-		rwbuf.last_node=node;
-		rwbuf.first_node=rwbuf.first_node->next_node;
-		return rwbuf.last_node;
+	else {				/* full, take the first one */
+		node = rwbuf.first_node;
+		rwbuf.first_node = node->next_node;
+		if (!rwbuf.first_node)
+			rwbuf.last_node = 0;
 	}
-	return 0;
-}
-
-PRIVATE void invalid_buf(u32 start, u32 end){                   //将缓存设为无效
-	// for(int i=1;i<RWBUF_SIZE;i++)
-	// {
-	// 	if(rwbuff[i].sec_nr>=start&&rwbuff[i].sec_nr<=end)
-	// 		rwbuff[i].valid=0;
-	// }
 
+	node->sec_nr = idx;
+	node->next_node = 0;
+	if (rwbuf.last_node)
+		rwbuf.last_node->next_node = node;
+	else
+		rwbuf.first_node = node;
+	rwbuf.last_node = node;
 
-	struct buf_node* node=rwbuf.first_node;
+	return node;
+}
 
-	if(node->sec_nr>=start&&node->sec_nr<=end){            //先判断第一个
-		rwbuf.first_node=rwbuf.first_node->next_node;
-		node=rwbuf.first_node;
-		rwbuf.node_nr--;
-	}
-	while(node)                                 //判断以后的
-	{
-		if(node->next_node->sec_nr>=start&&node->next_node->sec_nr<=end){
-		node->next_node=node->next_node->next_node;
-		rwbuf.node_nr--;
+/*****************************************************************************
+ *                                invalid_buf
+ *****************************************************************************/
+/**
+ * <Ring 1> Drop the sectors in [start, end] from the buffer.
+ * 
+ * @param start  The first sector.
+ * @param end    The last sector.
+ *****************************************************************************/
+PRIVATE void invalid_buf(u32 start, u32 end)
+{
+	struct buf_node* prev = 0;
+	struct buf_node* node = rwbuf.first_node;
+
+	while (node) {
+		struct buf_node* next = node->next_node;
+
+		if (node->sec_nr >= start && node->sec_nr <= end) {
+			if (prev)
+				prev->next_node = next;
+			else
+				rwbuf.first_node = next;
+			if (node == rwbuf.last_node)
+				rwbuf.last_node = prev;
+
+			node->next_node = rwbuf_free;
+			rwbuf_free = node;
+			rwbuf.node_nr--;
 		}
+		else
+			prev = node;
 
-		node=node->next_node;
+		node = next;
 	}
-}
\ No newline at end of file
+}
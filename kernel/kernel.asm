@@ -396,10 +396,11 @@ save:
 sys_call:
         call    save
 
-        sti
 	push	esi
 
-	push	dword [p_proc_ready]
+	push	dword [p_proc_ready]	; must be fetched before `sti', an
+					; interrupt may switch p_proc_ready
+        sti
 	push	edx
 	push	ecx
 	push	ebx
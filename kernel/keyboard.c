@@ -63,7 +63,7 @@ PUBLIC void keyboard_handler(int irq)
 		kb_in.count++;
 	}
 
-	key_pressed = 1;
+	inform_int(TASK_TTY, irq);
 }
 
 
@@ -0,0 +1,124 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kinfo.c
+ * @brief  Kernel info page.
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/**
+ * Every proc has a struct kinfo of its own in kinfo[], described by the
+ * INDEX_LDT_INFO descriptor in its LDT, and %fs is loaded with it. So
+ * everybody can read `ticks', the time and its own PID without sending any
+ * message, while nobody can write to the page but the kernel.
+ *
+ * Together with the TSC, the page is also all one needs to tell the time
+ * down to the nanosecond, @see lib/time.c
+ */
+
+/*****************************************************************************
+ *                                init_kinfo
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Set up the info page of a proc.
+ * 
+ * @param p  The proc.
+ *****************************************************************************/
+PUBLIC void init_kinfo(struct proc * p)
+{
+	int pid = proc2pid(p);
+
+	/* la == va for the kernel, @see va2la() */
+	init_desc(&p->ldts[INDEX_LDT_INFO],
+		  (u32)&kinfo[pid],
+		  sizeof(struct kinfo) - 1,
+		  DA_32 | DA_DR | PRIVILEGE_USER << 5);
+
+	u32 eflags = save_and_disable_int();
+	if (pid != 0)
+		kinfo[pid] = kinfo[0];
+	kinfo[pid].pid = pid;
+	kinfo[pid].seq++;
+	restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                update_kinfo
+ *****************************************************************************/
+/**
+ * <Ring 0> Bring `ticks' in all info pages up to date. Called on each clock
+ * tick.
+ * 
+ *****************************************************************************/
+PUBLIC void update_kinfo()
+{
+	u64 tsc = read_tsc();
+	struct kinfo * k;
+
+	for (k = kinfo; k < kinfo + NR_TASKS + NR_PROCS; k++) {
+		k->ticks = ticks;
+		k->tsc = tsc;
+		k->seq++;
+	}
+}
+
+/*****************************************************************************
+ *                                set_kinfo_tsc
+ *****************************************************************************/
+/**
+ * <Ring 0> Put the result of the TSC calibration into all info pages.
+ * 
+ * @param boot_tsc  TSC when clock_ns() was zero.
+ * @param mult      @see struct kinfo
+ * @param shift     @see struct kinfo
+ *****************************************************************************/
+PUBLIC void set_kinfo_tsc(u64 boot_tsc, u32 mult, int shift)
+{
+	u32 eflags = save_and_disable_int();
+	struct kinfo * k;
+
+	for (k = kinfo; k < kinfo + NR_TASKS + NR_PROCS; k++) {
+		k->boot_tsc = boot_tsc;
+		k->tsc_mult = mult;
+		k->tsc_shift = shift;
+		k->seq++;
+	}
+
+	restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                set_kinfo_rtc
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Put the wall clock just read from the RTC into all info pages.
+ * 
+ * @param sec  The wall clock, in seconds since 1970.
+ * @param ns   clock_ns() when the RTC was read.
+ *****************************************************************************/
+PUBLIC void set_kinfo_rtc(u32 sec, u64 ns)
+{
+	u32 eflags = save_and_disable_int();
+	struct kinfo * k;
+
+	for (k = kinfo; k < kinfo + NR_TASKS + NR_PROCS; k++) {
+		k->rtc_sec = sec;
+		k->rtc_ns = ns;
+		k->seq++;
+	}
+
+	restore_int(eflags);
+}
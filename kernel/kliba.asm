@@ -18,13 +18,21 @@ global	disp_str
 global	disp_color_str
 global	out_byte
 global	in_byte
+global	out_dword
+global	in_dword
 global	enable_irq
 global	disable_irq
 global	enable_int
 global	disable_int
+global	save_and_disable_int
+global	restore_int
+global	read_tsc
 global	port_read
 global	port_write
+global	port_read32
+global	port_write32
 global	glitter
+global	switch_stack
 
 
 
@@ -126,6 +134,23 @@ in_byte:
 	nop
 	ret
 
+; ========================================================================
+;		   void out_dword(u16 port, u32 value);
+; ========================================================================
+out_dword:
+	mov	edx, [esp + 4]		; port
+	mov	eax, [esp + 4 + 4]	; value
+	out	dx, eax
+	ret
+
+; ========================================================================
+;		   u32 in_dword(u16 port);
+; ========================================================================
+in_dword:
+	mov	edx, [esp + 4]		; port
+	in	eax, dx
+	ret
+
 ; ========================================================================
 ;                  void port_read(u16 port, void* buf, int n);
 ; ========================================================================
@@ -150,6 +175,32 @@ port_write:
 	rep	outsw
 	ret
 
+; ========================================================================
+;                  void port_read32(u16 port, void* buf, int n);
+; ========================================================================
+; Same as port_read(), a dword at a time. n must be a multiple of 4.
+port_read32:
+	mov	edx, [esp + 4]		; port
+	mov	edi, [esp + 4 + 4]	; buf
+	mov	ecx, [esp + 4 + 4 + 4]	; n
+	shr	ecx, 2
+	cld
+	rep	insd
+	ret
+
+; ========================================================================
+;                  void port_write32(u16 port, void* buf, int n);
+; ========================================================================
+; Same as port_write(), a dword at a time. n must be a multiple of 4.
+port_write32:
+	mov	edx, [esp + 4]		; port
+	mov	esi, [esp + 4 + 4]	; buf
+	mov	ecx, [esp + 4 + 4 + 4]	; n
+	shr	ecx, 2
+	cld
+	rep	outsd
+	ret
+
 ; ========================================================================
 ;		   void disable_irq(int irq);
 ; ========================================================================
@@ -239,6 +290,53 @@ enable_int:
 	sti
 	ret
 
+; ========================================================================
+;		   u32 save_and_disable_int();
+; ========================================================================
+; Disable interrupts and return the old EFLAGS, which should be passed to
+; restore_int() later. Unlike disable_int()/enable_int(), the pair can be
+; nested and can be used no matter IF is set or not.
+save_and_disable_int:
+	pushfd
+	pop	eax
+	cli
+	ret
+
+; ========================================================================
+;		   void restore_int(u32 eflags);
+; ========================================================================
+restore_int:
+	push	dword [esp + 4]		; eflags
+	popfd
+	ret
+
+; ========================================================================
+;		   u64 read_tsc();
+; ========================================================================
+read_tsc:
+	rdtsc				; edx:eax <- TSC
+	ret
+
+; ========================================================================
+;		   void switch_stack(u32 * old_esp, u32 new_esp);
+; ========================================================================
+; Save the callee-saved registers on the current stack and the stack ptr in
+; *old_esp, then go to the other stack, which was saved the same way.
+switch_stack:
+	mov	eax, [esp + 4]		; old_esp
+	mov	edx, [esp + 8]		; new_esp
+	push	ebp
+	push	ebx
+	push	esi
+	push	edi
+	mov	[eax], esp
+	mov	esp, edx
+	pop	edi
+	pop	esi
+	pop	ebx
+	pop	ebp
+	ret
+
 ; ========================================================================
 ;                  void glitter(int row, int col);
 ; ========================================================================
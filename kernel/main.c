@@ -95,26 +95,43 @@ PUBLIC int kernel_main()
 		p->regs.cs = INDEX_LDT_C << 3 |	SA_TIL | rpl;
 		p->regs.ds =
 			p->regs.es =
-			p->regs.fs =
 			p->regs.ss = INDEX_LDT_RW << 3 | SA_TIL | rpl;
+		p->regs.fs = INDEX_LDT_INFO << 3 | SA_TIL | rpl;
 		p->regs.gs = (SELECTOR_KERNEL_GS & SA_RPL_MASK) | rpl;
 		p->regs.eip	= (u32)t->initial_eip;
 		p->regs.esp	= (u32)stk;
 		p->regs.eflags	= eflags;
 
 		p->ticks = p->priority = prio;
+		p->q_prio = (i == TASK_IDLE) ? IDLE_Q : prio;
 
 		p->p_flags = 0;
 		p->p_msg = 0;
 		p->p_recvfrom = NO_TASK;
 		p->p_sendto = NO_TASK;
-		p->has_int_msg = 0;
+		p->p_sendrec = 0;
+		p->p_short = 0;
+		p->mb_head = 0;
+		p->mb_cnt = 0;
+		p->mb_io_cnt = 0;
+		p->int_pending = 0;
+		p->int_cnt = 0;
+		p->q_boosted = 0;
 		p->q_sending = 0;
+		p->q_sending_tail = 0;
 		p->next_sending = 0;
+		p->prev_sending = 0;
 
 		for (j = 0; j < NR_FILES; j++)
 			p->filp[j] = 0;
 
+		for (j = 0; j < NR_GRANTS; j++)
+			p->grants[j].g_rights = 0;
+
+		init_kinfo(p);
+
+		sched_sync(p);	/* into the run queue */
+
 		stk -= t->stacksize;
 	}
 
@@ -132,19 +149,6 @@ PUBLIC int kernel_main()
 }
 
 
-/*****************************************************************************
- *                                get_ticks
- *****************************************************************************/
-PUBLIC int get_ticks()
-{
-	MESSAGE msg;
-	reset_msg(&msg);
-	msg.type = GET_TICKS;
-	send_recv(BOTH, TASK_SYS, &msg);
-	return msg.RETVAL;
-}
-
-
 /**
  * @struct posix_tar_header
  * Borrowed from GNU `tar'
@@ -357,28 +361,18 @@ void Init()
 }
 
 
-/*======================================================================*
-                               TestA
- *======================================================================*/
-void TestA()
-{
-	for(;;);
-}
-
-/*======================================================================*
-                               TestB
- *======================================================================*/
-void TestB()
-{
-	for(;;);
-}
-
-/*======================================================================*
-                               TestB
- *======================================================================*/
-void TestC()
+/*****************************************************************************
+ *                                task_idle
+ *****************************************************************************/
+/**
+ * <Ring 1> The proc which runs when nobody else can. It is the only one in
+ * IDLE_Q and does nothing but halt the CPU until the next interrupt.
+ * 
+ *****************************************************************************/
+PUBLIC void task_idle()
 {
-	for(;;);
+	while (1)
+		halt();
 }
 
 /*****************************************************************************
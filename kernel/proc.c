@@ -20,36 +20,187 @@
 PRIVATE void block(struct proc* p);
 PRIVATE void unblock(struct proc* p);
 PRIVATE int  msg_send(struct proc* current, int dest, MESSAGE* m);
+PRIVATE int  msg_send_async(struct proc* current, int dest, MESSAGE* m);
 PRIVATE int  msg_receive(struct proc* current, int src, MESSAGE* m);
+PRIVATE int  mailbox_get(struct proc* p, int src, MESSAGE* m);
+PRIVATE int  msg_ready(struct proc* p, int src);
+PRIVATE void recv_expired(struct timer * t);
 PRIVATE int  deadlock(int src, int dest);
+PRIVATE int  do_sendrec(int function, int src_dest, MESSAGE* m,
+			struct proc* p);
+PRIVATE void copy_msg(struct proc* dst, MESSAGE* dm,
+		      struct proc* src, MESSAGE* sm);
+PRIVATE void put_msg(struct proc* dst, MESSAGE* dm, void* from, int len);
+PRIVATE int  msg_type(struct proc* p, MESSAGE* m);
+PRIVATE void sendq_insert(struct proc* dest, struct proc* p);
+PRIVATE void sendq_remove(struct proc* dest, struct proc* p);
+PRIVATE void inherit_prio(struct proc* p);
+PRIVATE void enqueue(struct proc* p);
+PRIVATE void dequeue(struct proc* p);
+PRIVATE struct proc* pick_proc();
+
+PRIVATE struct proc*	rdy_head[NR_SCHED_QUEUES]; /* heads of run queues */
+PRIVATE struct proc*	rdy_tail[NR_SCHED_QUEUES]; /* tails of run queues */
+PRIVATE u32		rdy_bitmap; /* bit q is set iff rdy_head[q] != 0 */
+
+PRIVATE struct timer	recv_timer[NR_TASKS + NR_PROCS]; /* RECEIVE_TIMED */
 
 /*****************************************************************************
  *                                schedule
  *****************************************************************************/
 /**
  * <Ring 0> Choose one proc to run.
+ *
+ * If the current proc has used up its time slice, it is given a new one and
+ * moved to the tail of its run queue (a user proc is demoted by one level
+ * first, unless it is running on an inherited priority). Then the head of
+ * the highest non-empty run queue is chosen.
  * 
  *****************************************************************************/
 PUBLIC void schedule()
 {
-	struct proc*	p;
-	int		greatest_ticks = 0;
-
-	while (!greatest_ticks) {
-		for (p = &FIRST_PROC; p <= &LAST_PROC; p++) {
-			if (p->p_flags == 0) {
-				if (p->ticks > greatest_ticks) {
-					greatest_ticks = p->ticks;
-					p_proc_ready = p;
-				}
-			}
-		}
+	u32 eflags = save_and_disable_int();
+	struct proc* p = p_proc_ready;
+
+	if (p->p_flags == 0 && p->ticks == 0) {
+		dequeue(p);
+		p->ticks = p->priority;
+		if (proc2pid(p) >= NR_TASKS && !p->q_boosted &&
+		    p->q_prio > MIN_USER_Q)
+			p->q_prio--;
+		enqueue(p);
+	}
 
-		if (!greatest_ticks)
-			for (p = &FIRST_PROC; p <= &LAST_PROC; p++)
-				if (p->p_flags == 0)
-					p->ticks = p->priority;
+	struct proc* next = pick_proc();
+	if (next != p) {
+		if (p->p_flags)
+			p->nr_vol_sw++;
+		else
+			p->nr_invol_sw++;
+		trace_event(TRC_SCHED, proc2pid(p), proc2pid(next), 0);
 	}
+	p_proc_ready = next;
+
+	restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                pick_proc
+ *****************************************************************************/
+/**
+ * <Ring 0> Find the head of the highest non-empty run queue.
+ * 
+ * @return The proc to run next.
+ *****************************************************************************/
+PRIVATE struct proc* pick_proc()
+{
+	int q;
+
+	if (!rdy_bitmap)
+		panic("no runnable proc");
+
+	/* find the highest set bit */
+	__asm__ __volatile__("bsrl %1, %0" : "=r"(q) : "r"(rdy_bitmap));
+
+	assert(rdy_head[q]);
+	assert(rdy_head[q]->p_flags == 0);
+	return rdy_head[q];
+}
+
+/*****************************************************************************
+ *                                enqueue
+ *****************************************************************************/
+/**
+ * <Ring 0> Append a proc to the tail of the run queue of its priority.
+ * Nothing will be done if the proc is already in a run queue.
+ *
+ * @attention Interrupts must be disabled by the caller.
+ * 
+ * @param p The proc to be enqueued.
+ *****************************************************************************/
+PRIVATE void enqueue(struct proc* p)
+{
+	int q = p->q_prio;
+
+	if (p->in_rq)
+		return;
+
+	assert(q >= 0 && q < NR_SCHED_QUEUES);
+
+	p->next_ready = 0;
+	if (rdy_head[q])
+		rdy_tail[q]->next_ready = p;
+	else
+		rdy_head[q] = p;
+	rdy_tail[q] = p;
+	rdy_bitmap |= 1 << q;
+
+	p->in_rq = 1;
+}
+
+/*****************************************************************************
+ *                                dequeue
+ *****************************************************************************/
+/**
+ * <Ring 0> Remove a proc from its run queue. Nothing will be done if the proc
+ * is not in any run queue.
+ *
+ * The proc to be removed is almost always the running one, which is the head
+ * of its queue, so the walk below normally stops at once.
+ *
+ * @attention Interrupts must be disabled by the caller.
+ * 
+ * @param p The proc to be dequeued.
+ *****************************************************************************/
+PRIVATE void dequeue(struct proc* p)
+{
+	int q = p->q_prio;
+	struct proc* prev = 0;
+	struct proc* x;
+
+	if (!p->in_rq)
+		return;
+
+	for (x = rdy_head[q]; x != p; x = x->next_ready) {
+		assert(x);
+		prev = x;
+	}
+
+	if (prev)
+		prev->next_ready = p->next_ready;
+	else
+		rdy_head[q] = p->next_ready;
+
+	if (rdy_tail[q] == p)
+		rdy_tail[q] = prev;
+
+	if (!rdy_head[q])
+		rdy_bitmap &= ~(1 << q);
+
+	p->next_ready = 0;
+	p->in_rq = 0;
+}
+
+/*****************************************************************************
+ *                                sched_sync
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Put a proc into its run queue if it is runnable, or take it out
+ * if it is not. Code outside this file which changes `p_flags' directly (MM,
+ * for example) must call this routine afterwards.
+ * 
+ * @param p The proc whose `p_flags' has just been changed.
+ *****************************************************************************/
+PUBLIC void sched_sync(struct proc* p)
+{
+	u32 eflags = save_and_disable_int();
+
+	if (p->p_flags == 0)
+		enqueue(p);
+	else
+		dequeue(p);
+
+	restore_int(eflags);
 }
 
 /*****************************************************************************
@@ -57,13 +208,19 @@ PUBLIC void schedule()
  *****************************************************************************/
 /**
  * <Ring 0> The core routine of system call `sendrec()'.
+ *
+ * BOTH is done in one trap: the request is sent and the caller goes on
+ * receiving from the same proc at once. If the peer is not receiving yet,
+ * the caller waits in its sending queue and is turned into RECEIVING by
+ * msg_receive() when the request is taken, so it is not woken up in between.
  * 
- * @param function SEND or RECEIVE
+ * @param function SEND, RECEIVE, BOTH, SEND_ASYNC or RECEIVE_TIMED
  * @param src_dest To/From whom the message is transferred.
  * @param m        Ptr to the MESSAGE body.
  * @param p        The caller proc.
  * 
- * @return Zero if success.
+ * @return Zero if success, MAILBOX_FULL if a SEND_ASYNC fails, TIMED_OUT if
+ *         a RECEIVE_TIMED with a zero TIMEOUT finds nothing.
  *****************************************************************************/
 PUBLIC int sys_sendrec(int function, int src_dest, MESSAGE* m, struct proc* p)
 {
@@ -72,35 +229,184 @@ PUBLIC int sys_sendrec(int function, int src_dest, MESSAGE* m, struct proc* p)
 	       src_dest == ANY ||
 	       src_dest == INTERRUPT);
 
-	int ret = 0;
 	int caller = proc2pid(p);
 	MESSAGE* mla = (MESSAGE*)va2la(caller, m);
 	mla->source = caller;
 
 	assert(mla->source != src_dest);
 
+	p->p_short = 0;
+	return do_sendrec(function, src_dest, m, p);
+}
+
+/*****************************************************************************
+ *                                sys_sendrec_short
+ *****************************************************************************/
+/**
+ * <Ring 0> The core routine of system call `sendrec_short()'.
+ *
+ * A short message is `type' and the first 4 words of `u', passed in the
+ * caller's registers: ecx, edx, esi, edi and ebp. The message is kept in
+ * p->short_msg, and only SHORT_MSG_SIZE bytes are copied to or from the
+ * peer. The reply, if any, is put back to the registers with the source in
+ * ebx, @see put_msg().
+ * 
+ * @param fn_src  (src_dest << 2) | function, function is SEND, RECEIVE or
+ *                BOTH, src_dest must be a certain proc.
+ * @param type    msg type, i.e. ecx.
+ * @param w1      u.m3.m3i1, i.e. edx. The others are in p->regs.
+ * @param p       The caller proc.
+ * 
+ * @return Zero if success.
+ *****************************************************************************/
+PUBLIC int sys_sendrec_short(int fn_src, int type, int w1, struct proc* p)
+{
+	int function = fn_src & BOTH;
+	int src_dest = fn_src >> 2;
+	MESSAGE* m = &p->short_msg;
+
+	assert(k_reenter == 0);	/* make sure we are not in ring0 */
+	assert(src_dest >= 0 && src_dest < NR_TASKS + NR_PROCS);
+	assert(src_dest != proc2pid(p));
+
+	m->source = proc2pid(p);
+	m->type = type;
+	m->u.m3.m3i1 = w1;
+	m->u.m3.m3i2 = p->regs.esi;
+	m->u.m3.m3i3 = p->regs.edi;
+	m->u.m3.m3i4 = p->regs.ebp;
+
+	p->p_short = 1;
+	return do_sendrec(function, src_dest, m, p);
+}
+
+/*****************************************************************************
+ *                                sys_sendvec
+ *****************************************************************************/
+/**
+ * <Ring 0> The core routine of system call `sendvec()'.
+ *
+ * msgs[i] is sent to dests[i] as SEND_ASYNC does, one after another, all in
+ * this one trap. A reply, if any, comes later as a msg of its own; one that
+ * carries the request's TAG back, as a block driver's completion does, can
+ * be put back into msgs[i] by the caller, @see fs_drv_submit().
+ * 
+ * @param n      How many msgs.
+ * @param dests  To whom the msgs are sent, each must be a certain proc.
+ * @param msgs   The msgs.
+ * @param p      The caller proc.
+ * 
+ * @return How many msgs are sent. It stops at the first one whose dest's
+ *         mailbox has no room for it.
+ *****************************************************************************/
+PUBLIC int sys_sendvec(int n, int* dests, MESSAGE* msgs, struct proc* p)
+{
+	int caller = proc2pid(p);
+	int * d = (int*)va2la(caller, dests);
+	MESSAGE* mla = (MESSAGE*)va2la(caller, msgs);
+	int i;
+
+	assert(k_reenter == 0);	/* make sure we are not in ring0 */
+	assert(n > 0);
+
+	p->p_short = 0;
+
+	u32 eflags = save_and_disable_int();
+	for (i = 0; i < n; i++) {
+		assert(d[i] >= 0 && d[i] < NR_TASKS + NR_PROCS &&
+		       d[i] != caller);
+		mla[i].source = caller;
+		if (msg_send_async(p, d[i], msgs + i) != 0)
+			break;
+		p->nr_sent++;
+	}
+	restore_int(eflags);
+
+	return i;
+}
+
+/*****************************************************************************
+ *                                do_sendrec
+ *****************************************************************************/
+/**
+ * <Ring 0> Send and/or receive a message for sys_sendrec() and
+ * sys_sendrec_short().
+ * 
+ * @param function SEND, RECEIVE, BOTH, SEND_ASYNC or RECEIVE_TIMED
+ * @param src_dest To/From whom the message is transferred.
+ * @param m        Ptr to the MESSAGE body.
+ * @param p        The caller proc.
+ * 
+ * @return Zero if success, MAILBOX_FULL if a SEND_ASYNC fails, TIMED_OUT if
+ *         a RECEIVE_TIMED with a zero TIMEOUT finds nothing.
+ *****************************************************************************/
+PRIVATE int do_sendrec(int function, int src_dest, MESSAGE* m, struct proc* p)
+{
+	int ret = 0;
+
 	/**
-	 * Actually we have the third message type: BOTH. However, it is not
-	 * allowed to be passed to the kernel directly. Kernel doesn't know
-	 * it at all. It is transformed into a SEND followed by a RECEIVE
-	 * by `send_recv()'.
+	 * Interrupt handlers may call inform_int() and touch the run queues,
+	 * so they are kept out until the message is delivered.
 	 */
+	u32 eflags = save_and_disable_int();
+
 	if (function == SEND) {
 		ret = msg_send(p, src_dest, m);
-		if (ret != 0)
-			return ret;
+		if (ret == 0)
+			p->nr_sent++;
 	}
 	else if (function == RECEIVE) {
 		ret = msg_receive(p, src_dest, m);
-		if (ret != 0)
-			return ret;
+		if (ret == 0)
+			p->nr_recv++;
+	}
+	else if (function == BOTH) {
+		assert(src_dest != ANY && src_dest != INTERRUPT);
+		p->p_sendrec = 1;
+		ret = msg_send(p, src_dest, m);
+		if (ret == 0)
+			p->nr_sent++;
+		if (ret == 0 && p->p_flags == 0) { /* delivered at once */
+			p->p_sendrec = 0;
+			ret = msg_receive(p, src_dest, m);
+			if (ret == 0)
+				p->nr_recv++;
+		}
+	}
+	else if (function == SEND_ASYNC) {
+		assert(src_dest != ANY && src_dest != INTERRUPT);
+		assert(!p->p_short);
+		ret = msg_send_async(p, src_dest, m);
+		if (ret == 0)
+			p->nr_sent++;
+	}
+	else if (function == RECEIVE_TIMED) {
+		assert(!p->p_short);
+		MESSAGE* mla = (MESSAGE*)va2la(proc2pid(p), m);
+		int timeout = mla->TIMEOUT;
+		if (timeout <= 0 && !msg_ready(p, src_dest)) { /* a poll */
+			mla->source = INTERRUPT;
+			mla->type = RECV_TIMEOUT;
+			ret = TIMED_OUT;
+		}
+		else {
+			ret = msg_receive(p, src_dest, m);
+			if (ret == 0)
+				p->nr_recv++;
+			if (p->p_flags & RECEIVING)
+				set_timer(&recv_timer[proc2pid(p)], timeout,
+					  recv_expired, proc2pid(p));
+		}
 	}
 	else {
-		panic("{sys_sendrec} invalid function: "
-		      "%d (SEND:%d, RECEIVE:%d).", function, SEND, RECEIVE);
+		panic("{do_sendrec} invalid function: %d (SEND:%d, RECEIVE:%d, "
+		      "BOTH:%d, SEND_ASYNC:%d, RECEIVE_TIMED:%d).",
+		      function, SEND, RECEIVE, BOTH, SEND_ASYNC, RECEIVE_TIMED);
 	}
 
-	return 0;
+	restore_int(eflags);
+
+	return ret;
 }
 
 /*****************************************************************************
@@ -165,7 +471,11 @@ PUBLIC void reset_msg(MESSAGE* p)
  *****************************************************************************/
 /**
  * <Ring 0> This routine is called after `p_flags' has been set (!= 0), it
- * calls `schedule()' to choose another proc as the `proc_ready'.
+ * takes the proc out of its run queue and calls `schedule()' to choose
+ * another proc as the `proc_ready'.
+ *
+ * A user proc blocking before its time slice is used up is considered
+ * interactive (or IPC-bound) and is promoted by one level.
  *
  * @attention This routine does not change `p_flags'. Make sure the `p_flags'
  * of the proc to be blocked has been set properly.
@@ -175,6 +485,18 @@ PUBLIC void reset_msg(MESSAGE* p)
 PRIVATE void block(struct proc* p)
 {
 	assert(p->p_flags);
+	dequeue(p);
+
+	p->blk_since = ticks;
+	p->blk_flags = p->p_flags;
+	trace_event(TRC_BLOCK, proc2pid(p),
+		    p->p_flags & SENDING ? p->p_sendto : p->p_recvfrom,
+		    p->p_flags);
+
+	if (proc2pid(p) >= NR_TASKS && !p->q_boosted &&
+	    p->ticks > 0 && p->q_prio < MAX_USER_Q)
+		p->q_prio++;
+
 	schedule();
 }
 
@@ -182,14 +504,35 @@ PRIVATE void block(struct proc* p)
  *                                unblock
  *****************************************************************************/
 /**
- * <Ring 0> This is a dummy routine. It does nothing actually. When it is
- * called, the `p_flags' should have been cleared (== 0).
+ * <Ring 0> Put the unblocked proc back to its run queue. When it is called,
+ * the `p_flags' should have been cleared (== 0).
+ *
+ * If the unblocked proc has a higher priority than `p_proc_ready', it is
+ * chosen at once instead of waiting for `p_proc_ready' to use up its time
+ * slice. The preempted proc stays at the head of its run queue, so it will
+ * resume with the ticks it has left.
  * 
  * @param p The unblocked proc.
  *****************************************************************************/
 PRIVATE void unblock(struct proc* p)
 {
 	assert(p->p_flags == 0);
+	enqueue(p);
+
+	reset_timer(&recv_timer[proc2pid(p)]); /* it's not needed any more */
+	trace_event(TRC_UNBLOCK, proc2pid(p), proc2pid(p), 0);
+
+	if (p->blk_flags & SENDING)
+		p->send_ticks += ticks - p->blk_since;
+	else if (p->blk_flags & RECEIVING)
+		p->recv_ticks += ticks - p->blk_since;
+	p->blk_flags = 0;
+
+	if (p->q_prio > p_proc_ready->q_prio) {
+		p_proc_ready->nr_invol_sw++;
+		trace_event(TRC_SCHED, proc2pid(p_proc_ready), proc2pid(p), 0);
+		p_proc_ready = p;
+	}
 }
 
 /*****************************************************************************
@@ -240,7 +583,8 @@ PRIVATE int deadlock(int src, int dest)
 /**
  * <Ring 0> Send a message to the dest proc. If dest is blocked waiting for
  * the message, copy the message to it and unblock dest. Otherwise the caller
- * will be blocked and appended to the dest's sending queue.
+ * will be blocked and put into the dest's sending queue, and dest inherits
+ * the caller's priority if it is higher than its own.
  * 
  * @param current  The caller, the sender.
  * @param dest     To whom the message is sent.
@@ -266,9 +610,9 @@ PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m)
 		assert(p_dest->p_msg);
 		assert(m);
 
-		phys_copy(va2la(dest, p_dest->p_msg),
-			  va2la(proc2pid(sender), m),
-			  sizeof(MESSAGE));
+		trace_event(TRC_DELIVER, proc2pid(sender), dest,
+			    msg_type(sender, m));
+		copy_msg(p_dest, p_dest->p_msg, sender, m);
 		p_dest->p_msg = 0;
 		p_dest->p_flags &= ~RECEIVING; /* dest has received the msg */
 		p_dest->p_recvfrom = NO_TASK;
@@ -289,18 +633,10 @@ PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m)
 		sender->p_sendto = dest;
 		sender->p_msg = m;
 
-		/* append to the sending queue */
-		struct proc * p;
-		if (p_dest->q_sending) {
-			p = p_dest->q_sending;
-			while (p->next_sending)
-				p = p->next_sending;
-			p->next_sending = sender;
-		}
-		else {
-			p_dest->q_sending = sender;
-		}
-		sender->next_sending = 0;
+		sendq_insert(p_dest, sender);
+		inherit_prio(p_dest);
+		trace_event(TRC_SEND, proc2pid(sender), dest,
+			    msg_type(sender, m));
 
 		block(sender);
 
@@ -313,6 +649,55 @@ PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m)
 	return 0;
 }
 
+/*****************************************************************************
+ *                                msg_send_async
+ *****************************************************************************/
+/**
+ * <Ring 0> Send a message to the dest proc without blocking. If dest is
+ * waiting for the message, it is delivered as msg_send() does. Otherwise it
+ * is copied into dest's mailbox, where msg_receive() will find it.
+ *
+ * Servers use this to reply, so that a client which is not receiving yet
+ * cannot hold them up.
+ *
+ * MB_IO_SLOTS of the mailbox are kept for DEV_READ and DEV_WRITE, i.e. the
+ * block requests and their completions, and the rest for the other msgs,
+ * so that neither kind can fill the mailbox up for the other.
+ * 
+ * @param current  The caller, the sender.
+ * @param dest     To whom the message is sent.
+ * @param m        The message.
+ * 
+ * @return Zero if success, MAILBOX_FULL if dest's mailbox has no room for
+ *         the msg. Nothing is sent in the latter case.
+ *****************************************************************************/
+PRIVATE int msg_send_async(struct proc* current, int dest, MESSAGE* m)
+{
+	struct proc* sender = current;
+	struct proc* p_dest = proc_table + dest; /* proc dest */
+
+	assert(proc2pid(sender) != dest);
+	assert(m);
+
+	if ((p_dest->p_flags & RECEIVING) && /* dest is waiting for the msg */
+	    (p_dest->p_recvfrom == proc2pid(sender) ||
+	     p_dest->p_recvfrom == ANY))
+		return msg_send(sender, dest, m); /* won't block */
+
+	MESSAGE* mla = (MESSAGE*)va2la(proc2pid(sender), m);
+	int io = mla->type == DEV_READ || mla->type == DEV_WRITE;
+	if (io ? p_dest->mb_io_cnt == MB_IO_SLOTS :
+	    p_dest->mb_cnt - p_dest->mb_io_cnt == MAILBOX_SIZE - MB_IO_SLOTS)
+		return MAILBOX_FULL;
+
+	int i = (p_dest->mb_head + p_dest->mb_cnt) % MAILBOX_SIZE;
+	phys_copy(&p_dest->mailbox[i], mla, sizeof(MESSAGE));
+	p_dest->mb_cnt++;
+	p_dest->mb_io_cnt += io;
+	trace_event(TRC_ASYNC, proc2pid(sender), dest, p_dest->mailbox[i].type);
+
+	return 0;
+}
 
 /*****************************************************************************
  *                                msg_receive
@@ -321,6 +706,9 @@ PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m)
  * <Ring 0> Try to get a message from the src proc. If src is blocked sending
  * the message, copy the message from it and unblock src. Otherwise the caller
  * will be blocked.
+ *
+ * Async messages in the caller's mailbox are older than anything in the
+ * sending queue of the same sender, so the mailbox is checked first.
  * 
  * @param current The caller, the proc who wanna receive.
  * @param src     From whom the message will be received.
@@ -337,12 +725,11 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m)
 						  * it.
 						  */
 	struct proc* p_from = 0; /* from which the message will be fetched */
-	struct proc* prev = 0;
 	int copyok = 0;
 
 	assert(proc2pid(p_who_wanna_recv) != src);
 
-	if ((p_who_wanna_recv->has_int_msg) &&
+	if ((p_who_wanna_recv->int_cnt) &&
 	    ((src == ANY) || (src == INTERRUPT))) {
 		/* There is an interrupt needs p_who_wanna_recv's handling and
 		 * p_who_wanna_recv is ready to handle it.
@@ -352,22 +739,35 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m)
 		reset_msg(&msg);
 		msg.source = INTERRUPT;
 		msg.type = HARD_INT;
+		msg.INT_IRQS = p_who_wanna_recv->int_pending;
+		msg.INT_CNT = p_who_wanna_recv->int_cnt;
 		assert(m);
 		phys_copy(va2la(proc2pid(p_who_wanna_recv), m), &msg,
 			  sizeof(MESSAGE));
 
-		p_who_wanna_recv->has_int_msg = 0;
+		p_who_wanna_recv->int_pending = 0;
+		p_who_wanna_recv->int_cnt = 0;
+		trace_event(TRC_RECV, INTERRUPT, proc2pid(p_who_wanna_recv),
+			    HARD_INT);
 
 		assert(p_who_wanna_recv->p_flags == 0);
 		assert(p_who_wanna_recv->p_msg == 0);
 		assert(p_who_wanna_recv->p_sendto == NO_TASK);
-		assert(p_who_wanna_recv->has_int_msg == 0);
+		assert(p_who_wanna_recv->int_cnt == 0);
 
 		return 0;
 	}
 
 
 	/* Arrives here if no interrupt for p_who_wanna_recv. */
+	if (src != INTERRUPT && mailbox_get(p_who_wanna_recv, src, m)) {
+		assert(p_who_wanna_recv->p_flags == 0);
+		assert(p_who_wanna_recv->p_msg == 0);
+		assert(p_who_wanna_recv->p_sendto == NO_TASK);
+
+		return 0;
+	}
+
 	if (src == ANY) {
 		/* p_who_wanna_recv is ready to receive messages from
 		 * ANY proc, we'll check the sending queue and pick the
@@ -401,20 +801,6 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m)
 			 */
 			copyok = 1;
 
-			struct proc* p = p_who_wanna_recv->q_sending;
-			assert(p); /* p_from must have been appended to the
-				    * queue, so the queue must not be NULL
-				    */
-			while (p) {
-				assert(p_from->p_flags & SENDING);
-				if (proc2pid(p) == src) { /* if p is the one */
-					p_from = p;
-					break;
-				}
-				prev = p;
-				p = p->next_sending;
-			}
-
 			assert(p_who_wanna_recv->p_flags == 0);
 			assert(p_who_wanna_recv->p_msg == 0);
 			assert(p_who_wanna_recv->p_recvfrom == NO_TASK);
@@ -433,28 +819,34 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m)
 		 * waiting for this moment in the queue, so we should
 		 * remove it from the queue.
 		 */
-		if (p_from == p_who_wanna_recv->q_sending) { /* the 1st one */
-			assert(prev == 0);
-			p_who_wanna_recv->q_sending = p_from->next_sending;
-			p_from->next_sending = 0;
-		}
-		else {
-			assert(prev);
-			prev->next_sending = p_from->next_sending;
-			p_from->next_sending = 0;
-		}
+		sendq_remove(p_who_wanna_recv, p_from);
+		inherit_prio(p_who_wanna_recv);
+		trace_event(TRC_RECV, proc2pid(p_from),
+			    proc2pid(p_who_wanna_recv),
+			    msg_type(p_from, p_from->p_msg));
 
 		assert(m);
 		assert(p_from->p_msg);
 		/* copy the message */
-		phys_copy(va2la(proc2pid(p_who_wanna_recv), m),
-			  va2la(proc2pid(p_from), p_from->p_msg),
-			  sizeof(MESSAGE));
+		copy_msg(p_who_wanna_recv, m, p_from, p_from->p_msg);
 
-		p_from->p_msg = 0;
 		p_from->p_sendto = NO_TASK;
 		p_from->p_flags &= ~SENDING;
-		unblock(p_from);
+		if (p_from->p_sendrec) {
+			/* the reply goes to the same buffer */
+			p_from->p_sendrec = 0;
+			p_from->p_flags |= RECEIVING;
+			p_from->p_recvfrom = proc2pid(p_who_wanna_recv);
+			p_from->nr_recv++;
+
+			p_from->send_ticks += ticks - p_from->blk_since;
+			p_from->blk_since = ticks;
+			p_from->blk_flags = RECEIVING;
+		}
+		else {
+			p_from->p_msg = 0;
+			unblock(p_from);
+		}
 	}
 	else {  /* nobody's sending any msg */
 		/* Set p_flags so that p_who_wanna_recv will not
@@ -475,30 +867,322 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m)
 		assert(p_who_wanna_recv->p_msg != 0);
 		assert(p_who_wanna_recv->p_recvfrom != NO_TASK);
 		assert(p_who_wanna_recv->p_sendto == NO_TASK);
-		assert(p_who_wanna_recv->has_int_msg == 0);
+		assert(p_who_wanna_recv->int_cnt == 0);
 	}
 
 	return 0;
 }
 
+/*****************************************************************************
+ *                                sendq_insert
+ *****************************************************************************/
+/**
+ * <Ring 0> Put a sender into dest's sending queue, behind all the senders of
+ * the same or a higher priority. The walk starts from the tail, so it stops
+ * at once unless the new sender outranks somebody.
+ * 
+ * @param dest  Whose sending queue.
+ * @param p     The sender.
+ *****************************************************************************/
+PRIVATE void sendq_insert(struct proc* dest, struct proc* p)
+{
+	struct proc* x = dest->q_sending_tail;
+
+	while (x && x->q_prio < p->q_prio)
+		x = x->prev_sending;
+
+	/* p goes right after x */
+	p->prev_sending = x;
+	p->next_sending = x ? x->next_sending : dest->q_sending;
+
+	if (p->next_sending)
+		p->next_sending->prev_sending = p;
+	else
+		dest->q_sending_tail = p;
+
+	if (x)
+		x->next_sending = p;
+	else
+		dest->q_sending = p;
+}
+
+/*****************************************************************************
+ *                                sendq_remove
+ *****************************************************************************/
+/**
+ * <Ring 0> Take a sender out of dest's sending queue.
+ * 
+ * @param dest  Whose sending queue.
+ * @param p     The sender.
+ *****************************************************************************/
+PRIVATE void sendq_remove(struct proc* dest, struct proc* p)
+{
+	if (p->prev_sending)
+		p->prev_sending->next_sending = p->next_sending;
+	else
+		dest->q_sending = p->next_sending;
+
+	if (p->next_sending)
+		p->next_sending->prev_sending = p->prev_sending;
+	else
+		dest->q_sending_tail = p->prev_sending;
+
+	p->next_sending = 0;
+	p->prev_sending = 0;
+}
+
+/*****************************************************************************
+ *                                inherit_prio
+ *****************************************************************************/
+/**
+ * <Ring 0> Let a proc run at the priority of the first sender waiting on it,
+ * if that is higher than its own, or drop it back to its own level when no
+ * such sender is left. If the proc is itself blocked sending, the change is
+ * passed along the chain, so a server waiting on another server does not
+ * hold up a high-priority client either.
+ * 
+ * @param p  The proc whose sending queue has just changed.
+ *****************************************************************************/
+PRIVATE void inherit_prio(struct proc* p)
+{
+	while (1) {
+		int own = p->q_boosted ? p->q_own : p->q_prio;
+		int q = own;
+
+		if (p->q_sending && p->q_sending->q_prio > q)
+			q = p->q_sending->q_prio;
+
+		p->q_boosted = (q != own);
+		p->q_own = own;
+
+		if (q == p->q_prio)
+			break;
+
+		if (p->in_rq) {
+			dequeue(p);
+			p->q_prio = q;
+			enqueue(p);
+		}
+		else {
+			p->q_prio = q;
+		}
+
+		if (!(p->p_flags & SENDING))
+			break;
+
+		/* keep p's place in the queue it's waiting in up to date */
+		struct proc* dest = proc_table + p->p_sendto;
+		sendq_remove(dest, p);
+		sendq_insert(dest, p);
+		p = dest;
+	}
+}
+
+/*****************************************************************************
+ *                                copy_msg
+ *****************************************************************************/
+/**
+ * <Ring 0> Copy a message from one proc to another. If either of them is
+ * doing a short sendrec, the message lives in its short_msg and only
+ * SHORT_MSG_SIZE bytes are copied. A short receiver gets the message in its
+ * registers as well.
+ * 
+ * @param dst  The receiver.
+ * @param dm   Where the receiver wants the message.
+ * @param src  The sender.
+ * @param sm   Where the sender's message is.
+ *****************************************************************************/
+PRIVATE void copy_msg(struct proc* dst, MESSAGE* dm,
+		      struct proc* src, MESSAGE* sm)
+{
+	void* from = src->p_short ? (void*)sm : va2la(proc2pid(src), sm);
+
+	put_msg(dst, dm, from, src->p_short ? SHORT_MSG_SIZE : sizeof(MESSAGE));
+}
+
+/*****************************************************************************
+ *                                put_msg
+ *****************************************************************************/
+/**
+ * <Ring 0> Put a message into the receiver's buffer, and into its registers
+ * if it is doing a short sendrec.
+ *
+ * The part of a full MESSAGE which a short one does not have is zeroed, so
+ * that the receiver does not see what was left there from before.
+ * 
+ * @param dst   The receiver.
+ * @param dm    Where the receiver wants the message.
+ * @param from  Linear address of the message.
+ * @param len   At most how many bytes of it are meaningful.
+ *****************************************************************************/
+PRIVATE void put_msg(struct proc* dst, MESSAGE* dm, void* from, int len)
+{
+	void* to = dst->p_short ? (void*)dm : va2la(proc2pid(dst), dm);
+
+	phys_copy(to, from, dst->p_short ? SHORT_MSG_SIZE : len);
+	if (!dst->p_short && len < sizeof(MESSAGE))
+		memset(to + len, 0, sizeof(MESSAGE) - len);
+
+	if (dst->p_short) {
+		assert(dm == &dst->short_msg);
+		dst->regs.ebx = dm->source;
+		dst->regs.ecx = dm->type;
+		dst->regs.edx = dm->u.m3.m3i1;
+		dst->regs.esi = dm->u.m3.m3i2;
+		dst->regs.edi = dm->u.m3.m3i3;
+		dst->regs.ebp = dm->u.m3.m3i4;
+	}
+}
+
+/*****************************************************************************
+ *                                msg_type
+ *****************************************************************************/
+/**
+ * <Ring 0> Get the type of a message for the IPC trace.
+ * 
+ * @param p  Whose message, who may be doing a short sendrec.
+ * @param m  Where p's message is.
+ * 
+ * @return The msg type.
+ *****************************************************************************/
+PRIVATE int msg_type(struct proc* p, MESSAGE* m)
+{
+	return p->p_short ? m->type : ((MESSAGE*)va2la(proc2pid(p), m))->type;
+}
+
+/*****************************************************************************
+ *                                mailbox_get
+ *****************************************************************************/
+/**
+ * <Ring 0> Take the oldest async message from src out of a proc's mailbox.
+ * 
+ * @param p    The receiver, whose mailbox is searched.
+ * @param src  From whom the message should be, or ANY.
+ * @param m    Where p wants the message.
+ * 
+ * @return Nonzero if a message is taken.
+ *****************************************************************************/
+PRIVATE int mailbox_get(struct proc* p, int src, MESSAGE* m)
+{
+	int i;
+	for (i = 0; i < p->mb_cnt; i++) {
+		MESSAGE* slot = &p->mailbox[(p->mb_head + i) % MAILBOX_SIZE];
+		if (src == ANY || slot->source == src)
+			break;
+	}
+	if (i == p->mb_cnt)
+		return 0;
+
+	MESSAGE* mb = &p->mailbox[(p->mb_head + i) % MAILBOX_SIZE];
+	put_msg(p, m, mb, sizeof(MESSAGE));
+	trace_event(TRC_RECV, mb->source, proc2pid(p), mb->type);
+	if (mb->type == DEV_READ || mb->type == DEV_WRITE)
+		p->mb_io_cnt--;
+
+	if (i == 0) {
+		p->mb_head = (p->mb_head + 1) % MAILBOX_SIZE;
+	}
+	else {	/* close the gap, the order of the rest is kept */
+		for (; i < p->mb_cnt - 1; i++)
+			p->mailbox[(p->mb_head + i) % MAILBOX_SIZE] =
+				p->mailbox[(p->mb_head + i + 1) % MAILBOX_SIZE];
+	}
+	p->mb_cnt--;
+
+	return 1;
+}
+
+/*****************************************************************************
+ *                                msg_ready
+ *****************************************************************************/
+/**
+ * <Ring 0> Tell whether msg_receive() would find a message at once.
+ * 
+ * @param p    The receiver.
+ * @param src  From whom, ANY or INTERRUPT.
+ * 
+ * @return Nonzero if there is a message.
+ *****************************************************************************/
+PRIVATE int msg_ready(struct proc* p, int src)
+{
+	int i;
+
+	if (p->int_cnt && (src == ANY || src == INTERRUPT))
+		return 1;
+	if (src == INTERRUPT)
+		return 0;
+
+	for (i = 0; i < p->mb_cnt; i++)
+		if (src == ANY ||
+		    p->mailbox[(p->mb_head + i) % MAILBOX_SIZE].source == src)
+			return 1;
+
+	if (src == ANY)
+		return p->q_sending != 0;
+
+	return (proc_table[src].p_flags & SENDING) &&
+		proc_table[src].p_sendto == proc2pid(p);
+}
+
+/*****************************************************************************
+ *                                recv_expired
+ *****************************************************************************/
+/**
+ * <Ring 0> Called by run_timers() when a RECEIVE_TIMED has waited long
+ * enough. The receiver gets a RECV_TIMEOUT message from INTERRUPT.
+ * 
+ * @param t  The timer of the receiver.
+ *****************************************************************************/
+PRIVATE void recv_expired(struct timer * t)
+{
+	struct proc* p = proc_table + t->data;
+
+	assert(p->p_flags == RECEIVING);
+	assert(p->p_msg);
+
+	MESSAGE* mla = (MESSAGE*)va2la(t->data, p->p_msg);
+	mla->source = INTERRUPT;
+	mla->type = RECV_TIMEOUT;
+
+	p->p_msg = 0;
+	p->p_flags &= ~RECEIVING;
+	p->p_recvfrom = NO_TASK;
+	unblock(p);
+}
+
 /*****************************************************************************
  *                                inform_int
  *****************************************************************************/
 /**
  * <Ring 0> Inform a proc that an interrupt has occured.
+ *
+ * If the proc is not receiving, the interrupt is recorded in its
+ * `int_pending' and `int_cnt', so that interrupts coming in a burst are
+ * neither lost nor delivered one by one: the next HARD_INT tells the proc
+ * all of them (INT_IRQS and INT_CNT).
  * 
  * @param task_nr  The task which will be informed.
+ * @param irq      Which IRQ, it is also used for the software interrupts of
+ *                 the clock, e.g. by TASK_SYS.
  *****************************************************************************/
-PUBLIC void inform_int(int task_nr)
+PUBLIC void inform_int(int task_nr, int irq)
 {
 	struct proc* p = proc_table + task_nr;
+	u32 eflags = save_and_disable_int();
+
+	p->int_pending |= 1 << irq;
+	p->int_cnt++;
+	trace_event(TRC_INT, INTERRUPT, task_nr, HARD_INT);
 
 	if ((p->p_flags & RECEIVING) && /* dest is waiting for the msg */
 	    ((p->p_recvfrom == INTERRUPT) || (p->p_recvfrom == ANY))) {
 		p->p_msg->source = INTERRUPT;
 		p->p_msg->type = HARD_INT;
+		p->p_msg->INT_IRQS = p->int_pending;
+		p->p_msg->INT_CNT = p->int_cnt;
 		p->p_msg = 0;
-		p->has_int_msg = 0;
+		p->int_pending = 0;
+		p->int_cnt = 0;
 		p->p_flags &= ~RECEIVING; /* dest has received the msg */
 		p->p_recvfrom = NO_TASK;
 		assert(p->p_flags == 0);
@@ -509,9 +1193,8 @@ PUBLIC void inform_int(int task_nr)
 		assert(p->p_recvfrom == NO_TASK);
 		assert(p->p_sendto == NO_TASK);
 	}
-	else {
-		p->has_int_msg = 1;
-	}
+
+	restore_int(eflags);
 }
 
 /*****************************************************************************
@@ -546,6 +1229,7 @@ PUBLIC void dump_proc(struct proc* p)
 	sprintf(info, "ldt_sel: 0x%x.  ", p->ldt_sel); disp_color_str(info, text_color);
 	sprintf(info, "ticks: 0x%x.  ", p->ticks); disp_color_str(info, text_color);
 	sprintf(info, "priority: 0x%x.  ", p->priority); disp_color_str(info, text_color);
+	sprintf(info, "q_prio: 0x%x.  ", p->q_prio); disp_color_str(info, text_color);
 	/* sprintf(info, "pid: 0x%x.  ", p->pid); disp_color_str(info, text_color); */
 	sprintf(info, "name: %s.  ", p->name); disp_color_str(info, text_color);
 	disp_color_str("\n", text_color);
@@ -554,7 +1238,8 @@ PUBLIC void dump_proc(struct proc* p)
 	sprintf(info, "p_sendto: 0x%x.  ", p->p_sendto); disp_color_str(info, text_color);
 	/* sprintf(info, "nr_tty: 0x%x.  ", p->nr_tty); disp_color_str(info, text_color); */
 	disp_color_str("\n", text_color);
-	sprintf(info, "has_int_msg: 0x%x.  ", p->has_int_msg); disp_color_str(info, text_color);
+	sprintf(info, "int_pending: 0x%x.  ", p->int_pending); disp_color_str(info, text_color);
+	sprintf(info, "int_cnt: 0x%x.  ", p->int_cnt); disp_color_str(info, text_color);
 }
 
 
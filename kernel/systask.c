@@ -22,6 +22,12 @@
 
 PRIVATE int read_register(char reg_addr);
 PRIVATE u32 get_rtc_time(struct time *t);
+PRIVATE int get_proc_stat(int src, struct proc_stat * buf, int nr);
+PRIVATE void sleep_expired(struct timer * t);
+PRIVATE void wake_sleepers();
+
+PRIVATE struct timer	sleep_timer[NR_TASKS + NR_PROCS];
+PRIVATE int		sleeping[NR_TASKS + NR_PROCS]; /* waiting for reply? */
 
 /*****************************************************************************
  *                                task_sys
@@ -35,6 +41,10 @@ PUBLIC void task_sys()
 	MESSAGE msg;
 	struct time t;
 
+	/* the RTC is read only once, gettimeofday() relies on the TSC */
+	get_rtc_time(&t);
+	set_kinfo_rtc(time2sec(&t), clock_ns());
+
 	while (1) {
 		send_recv(RECEIVE, ANY, &msg);
 		int src = msg.source;
@@ -57,6 +67,28 @@ PUBLIC void task_sys()
 				  sizeof(t));
 			send_recv(SEND, src, &msg);
 			break;
+		case GET_PROC_STAT:
+			msg.type = SYSCALL_RET;
+			msg.CNT = get_proc_stat(src, msg.BUF, msg.CNT);
+			send_recv(SEND, src, &msg);
+			break;
+		case TRACE_CTL:
+			msg.type = SYSCALL_RET;
+			msg.RETVAL = trace_on;
+			if (msg.REQUEST == TRACE_CLEAR)
+				trace_cnt = 0;
+			else
+				trace_on = msg.REQUEST;
+			send_recv(SEND, src, &msg);
+			break;
+		case SLEEP_TICKS:
+			/* the reply is sent by wake_sleepers() */
+			sleeping[src] = 1;
+			set_timer(&sleep_timer[src], msg.CNT, sleep_expired, src);
+			break;
+		case HARD_INT:
+			wake_sleepers();
+			break;
 		default:
 			panic("unknown msg type");
 			break;
@@ -65,6 +97,82 @@ PUBLIC void task_sys()
 }
 
 
+/*****************************************************************************
+ *                                sleep_expired
+ *****************************************************************************/
+/**
+ * <Ring 0> Called by run_timers() when a sleeper's time is up. TASK SYS is
+ * told by a HARD_INT message.
+ * 
+ * @param t  The timer of the sleeper.
+ *****************************************************************************/
+PRIVATE void sleep_expired(struct timer * t)
+{
+	inform_int(TASK_SYS, CLOCK_IRQ);
+}
+
+/*****************************************************************************
+ *                                wake_sleepers
+ *****************************************************************************/
+/**
+ * Reply to all sleepers whose timers have fired.
+ * 
+ *****************************************************************************/
+PRIVATE void wake_sleepers()
+{
+	MESSAGE msg;
+	int i;
+
+	for (i = 0; i < NR_TASKS + NR_PROCS; i++) {
+		if (!sleeping[i] || timer_pending(&sleep_timer[i]))
+			continue;
+
+		sleeping[i] = 0;
+		msg.type = SYSCALL_RET;
+		msg.RETVAL = 0;
+		send_recv(SEND, i, &msg);
+	}
+}
+
+/*****************************************************************************
+ *                                get_proc_stat
+ *****************************************************************************/
+/**
+ * Copy the accounting info of all proc_table[] slots to the caller.
+ * 
+ * @param src  The caller proc nr.
+ * @param buf  Array of struct proc_stat in the caller's address space.
+ * @param nr   How many entries the array can hold.
+ * 
+ * @return How many entries have been filled.
+ *****************************************************************************/
+PRIVATE int get_proc_stat(int src, struct proc_stat * buf, int nr)
+{
+	struct proc_stat ps;
+	struct proc * p = proc_table;
+	int i;
+
+	nr = min(nr, NR_TASKS + NR_PROCS);
+
+	for (i = 0; i < nr; i++, p++) {
+		memcpy(ps.name, p->name, sizeof(ps.name));
+		ps.p_flags	= p->p_flags;
+		ps.prio		= p->q_prio;
+		ps.user_ticks	= p->user_ticks;
+		ps.sys_ticks	= p->sys_ticks;
+		ps.nr_vol_sw	= p->nr_vol_sw;
+		ps.nr_invol_sw	= p->nr_invol_sw;
+		ps.nr_sent	= p->nr_sent;
+		ps.nr_recv	= p->nr_recv;
+		ps.send_ticks	= p->send_ticks;
+		ps.recv_ticks	= p->recv_ticks;
+
+		phys_copy(va2la(src, buf + i), va2la(TASK_SYS, &ps), sizeof(ps));
+	}
+
+	return nr;
+}
+
 /*****************************************************************************
  *                                get_rtc_time
  *****************************************************************************/
@@ -0,0 +1,247 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   timer.c
+ * @brief  Timer wheel.
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/**
+ * The timers are kept in a hierarchical wheel of five levels. The first
+ * level has one slot for each of the next 256 ticks; each further level
+ * has 64 slots, each of which covers a 64 times longer period than a slot
+ * of the level below. Adding and removing a timer are O(1). When the first
+ * level wraps around, the next slot of the second level is cascaded, i.e.
+ * its timers are spread over the first level, and so on.
+ */
+#define	TVR_BITS	8
+#define	TVN_BITS	6
+#define	TVR_SIZE	(1 << TVR_BITS)
+#define	TVN_SIZE	(1 << TVN_BITS)
+#define	TVR_MASK	(TVR_SIZE - 1)
+#define	TVN_MASK	(TVN_SIZE - 1)
+#define	NR_TVN		4
+
+/* index of slot in level n (0 ~ NR_TVN-1) of tvn[] for time t */
+#define	TVN_INDEX(t, n)	(((t) >> (TVR_BITS + (n) * TVN_BITS)) & TVN_MASK)
+
+PRIVATE struct timer *	tvr[TVR_SIZE];
+PRIVATE struct timer *	tvn[NR_TVN][TVN_SIZE];
+PRIVATE u32		timer_now; /* the next tick to be processed */
+
+PRIVATE void add_timer(struct timer * t);
+PRIVATE void del_timer(struct timer * t);
+PRIVATE int  cascade(int n, int index);
+
+/*****************************************************************************
+ *                                set_timer
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Arm a timer. If it is already pending it is rearmed.
+ * 
+ * @param t         The timer.
+ * @param nr_ticks  When to fire: 1 for the next tick, 2 for the one after
+ *                  it, etc.
+ * @param func      What to do then. It is called in ring 0 by the clock
+ *                  interrupt handler, so it should do nothing more than
+ *                  waking somebody up.
+ * @param data      For func().
+ *****************************************************************************/
+PUBLIC void set_timer(struct timer * t, int nr_ticks,
+		      void (*func)(struct timer * t), int data)
+{
+	assert(nr_ticks > 0);
+
+	u32 eflags = save_and_disable_int();
+
+	if (timer_pending(t))
+		del_timer(t);
+
+	t->expires = timer_now + nr_ticks - 1;
+	t->func = func;
+	t->data = data;
+	add_timer(t);
+
+	restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                reset_timer
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Disarm a timer. Nothing will be done if it is not pending.
+ * 
+ * @param t  The timer.
+ *****************************************************************************/
+PUBLIC void reset_timer(struct timer * t)
+{
+	u32 eflags = save_and_disable_int();
+
+	if (timer_pending(t))
+		del_timer(t);
+
+	restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                run_timers
+ *****************************************************************************/
+/**
+ * <Ring 0> Advance the wheel and fire the timers which have expired.
+ * 
+ * @param nr_ticks  How many ticks have passed since the last call.
+ *****************************************************************************/
+PUBLIC void run_timers(int nr_ticks)
+{
+	u32 eflags = save_and_disable_int();
+
+	while (nr_ticks--) {
+		int index = timer_now & TVR_MASK;
+
+		if (index == 0) {
+			int n;
+			for (n = 0; n < NR_TVN; n++)
+				if (cascade(n, TVN_INDEX(timer_now, n)) != 0)
+					break;
+		}
+
+		timer_now++;
+
+		while (tvr[index]) {
+			struct timer * t = tvr[index];
+			del_timer(t);
+			t->func(t);
+		}
+	}
+
+	restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                next_timer
+ *****************************************************************************/
+/**
+ * <Ring 0> Tell how long nothing will happen in the wheel.
+ * 
+ * Only the first level is looked at. If it wraps around before a pending
+ * timer is found, the tick at which it wraps is returned: the timers
+ * cascaded then may be due at once.
+ *
+ * @param max  Don't look further than this.
+ * 
+ * @return In how many ticks the next timer may fire, at most `max'.
+ *****************************************************************************/
+PUBLIC int next_timer(int max)
+{
+	int i;
+
+	for (i = 1; i < max; i++) {
+		int index = (timer_now + i - 1) & TVR_MASK;
+		if (tvr[index] || (index == 0))
+			break;
+	}
+
+	return i;
+}
+
+/*****************************************************************************
+ *                                add_timer
+ *****************************************************************************/
+/**
+ * <Ring 0> Link a timer into the slot its `expires' falls in.
+ *
+ * @attention Interrupts must be disabled by the caller.
+ * 
+ * @param t  The timer.
+ *****************************************************************************/
+PRIVATE void add_timer(struct timer * t)
+{
+	u32 expires = t->expires;
+	u32 delta = expires - timer_now;
+	struct timer ** slot;
+
+	if ((int)delta < 0)	/* already expired */
+		slot = &tvr[timer_now & TVR_MASK];
+	else if (delta < TVR_SIZE)
+		slot = &tvr[expires & TVR_MASK];
+	else if (delta < 1 << (TVR_BITS + TVN_BITS))
+		slot = &tvn[0][TVN_INDEX(expires, 0)];
+	else if (delta < 1 << (TVR_BITS + 2 * TVN_BITS))
+		slot = &tvn[1][TVN_INDEX(expires, 1)];
+	else if (delta < 1 << (TVR_BITS + 3 * TVN_BITS))
+		slot = &tvn[2][TVN_INDEX(expires, 2)];
+	else
+		slot = &tvn[3][TVN_INDEX(expires, 3)];
+
+	t->prev = 0;
+	t->next = *slot;
+	if (t->next)
+		t->next->prev = t;
+	*slot = t;
+	t->slot = slot;
+}
+
+/*****************************************************************************
+ *                                del_timer
+ *****************************************************************************/
+/**
+ * <Ring 0> Unlink a pending timer.
+ *
+ * @attention Interrupts must be disabled by the caller.
+ * 
+ * @param t  The timer.
+ *****************************************************************************/
+PRIVATE void del_timer(struct timer * t)
+{
+	if (t->prev)
+		t->prev->next = t->next;
+	else
+		*t->slot = t->next;
+
+	if (t->next)
+		t->next->prev = t->prev;
+
+	t->next = t->prev = 0;
+	t->slot = 0;
+}
+
+/*****************************************************************************
+ *                                cascade
+ *****************************************************************************/
+/**
+ * <Ring 0> Move all timers in a slot of an upper level down to where they
+ * belong now.
+ *
+ * @attention Interrupts must be disabled by the caller.
+ * 
+ * @param n      Which level in tvn[].
+ * @param index  Which slot.
+ * 
+ * @return The slot index, zero means the level above must be cascaded too.
+ *****************************************************************************/
+PRIVATE int cascade(int n, int index)
+{
+	struct timer * t = tvn[n][index];
+
+	tvn[n][index] = 0;
+	while (t) {
+		struct timer * next = t->next;
+		add_timer(t);
+		t = next;
+	}
+
+	return index;
+}
@@ -0,0 +1,71 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   trace.c
+ * @brief  IPC event trace.
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/**
+ * While `trace_on' is set, msg_send(), msg_receive(), inform_int(), block(),
+ * unblock() and schedule() each put a record into trace_ring[], which keeps
+ * the latest NR_TRACE_RECS of them. There is only one CPU, so there is only
+ * one ring.
+ *
+ * TASK SYS switches the recording on and off (TRACE_CTL), and TASK FS writes
+ * the ring into the log sectors (TRACE_DUMP), where scripts/ipctrace finds
+ * it, @see fs/disklog.c::do_trace_dump().
+ */
+
+/*****************************************************************************
+ *                                trace_event
+ *****************************************************************************/
+/**
+ * <Ring 0> Record an IPC event if the trace is on.
+ *
+ * @param event  TRC_xxx.
+ * @param src    Who sends, or the proc the event is about.
+ * @param dst    Who receives, or whom the proc is waiting for.
+ * @param type   The msg type, or p_flags for TRC_BLOCK.
+ *****************************************************************************/
+PUBLIC void trace_event(int event, int src, int dst, int type)
+{
+	if (!trace_on)
+		return;
+
+	u32 eflags = save_and_disable_int();
+
+	struct trace_rec * r = &trace_ring[trace_cnt & (NR_TRACE_RECS - 1)];
+	int depth = 0;
+
+	if (dst >= 0 && dst < NR_TASKS + NR_PROCS) {
+		struct proc * p = proc_table + dst;
+		struct proc * q;
+		for (q = p->q_sending; q; q = q->next_sending)
+			depth++;
+		depth += p->mb_cnt + p->int_cnt;
+	}
+
+	r->tr_tsc = read_tsc();
+	r->tr_type = type;
+	r->tr_event = event;
+	r->tr_qdepth = min(depth, 0xFF);
+	r->tr_src = src;
+	r->tr_dst = dst;
+	trace_cnt++;
+
+	restore_int(eflags);
+}
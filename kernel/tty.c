@@ -8,14 +8,13 @@
  *   - DEV_READ
  *   - DEV_WRITE
  *
- * Besides, it accepts the other two types of MESSAGE from clock_handler() and
+ * Besides, it accepts the other two types of MESSAGE from keyboard_handler() and
  * a PROC (who is not FS):
  *
- *   - MESSAGE from clock_handler(): HARD_INT
- *      - Every time clock interrupt occurs, the clock handler will check whether
- *        any key has been pressed. If so, it'll invoke inform_int() to wake up
- *        TTY. It is a special message because it is not from a process -- clock
- *        handler is not a process.
+ *   - MESSAGE from keyboard_handler(): HARD_INT
+ *      - Every time a keyboard interrupt occurs, the keyboard handler will
+ *        invoke inform_int() to wake up TTY. It is a special message because
+ *        it is not from a process -- keyboard handler is not a process.
  *
  *   - MESSAGE from a PROC: TTY_WRITE
  *      - TTY is a driver. In most cases MESSAGE is passed from a PROC to FS then
@@ -109,10 +108,10 @@ PUBLIC void task_tty()
 			break;
 		case HARD_INT:
 			/**
-			 * waked up by clock_handler -- a key was just pressed
-			 * @see clock_handler() inform_int()
+			 * waked up by keyboard_handler -- keys were just
+			 * pressed, they are all read at the top of the loop
+			 * @see keyboard_handler() inform_int()
 			 */
-			key_pressed = 0;
 			continue;
 		default:
 			dump_msg("TTY::unknown msg", &msg);
@@ -279,7 +278,7 @@ PRIVATE void tty_dev_write(TTY* tty)
 				msg.type = RESUME_PROC;
 				msg.PROC_NR = tty->tty_procnr;
 				msg.CNT = tty->tty_trans_cnt;
-				send_recv(SEND, tty->tty_caller, &msg);
+				send_async(tty->tty_caller, &msg);
 				tty->tty_left_cnt = 0;
 			}
 		}
@@ -341,8 +340,11 @@ PRIVATE void tty_do_write(TTY* tty, MESSAGE* msg)
 		p += bytes;
 	}
 
+	/* the caller may have been told to wait for TTY, @see do_rdwt() */
+	int dest = msg->FLAGS & DEV_REPLY_PROC ? msg->PROC_NR : msg->source;
+
 	msg->type = SYSCALL_RET;
-	send_recv(SEND, msg->source, msg);
+	send_async(dest, msg);
 }
 
 
@@ -35,7 +35,7 @@ PUBLIC int close(int fd)
 	msg.type   = CLOSE;
 	msg.FD     = fd;
 
-	send_recv(BOTH, TASK_FS, &msg);
+	send_recv_short(BOTH, TASK_FS, &msg);
 
 	return msg.RETVAL;
 }
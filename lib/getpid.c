@@ -24,17 +24,14 @@
  *                                getpid
  *****************************************************************************/
 /**
- * Get the PID.
+ * Get the PID. It is read from the kernel info page, no message is sent.
  * 
  * @return The PID.
  *****************************************************************************/
 PUBLIC int getpid()
 {
-	MESSAGE msg;
-	msg.type	= GET_PID;
+	struct kinfo k;
+	get_kinfo(&k);
 
-	send_recv(BOTH, TASK_SYS, &msg);
-	assert(msg.type == SYSCALL_RET);
-
-	return msg.PID;
+	return k.pid;
 }
@@ -0,0 +1,45 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   getpstat.c
+ * @brief  getpstat()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+
+/*****************************************************************************
+ *                                getpstat
+ *****************************************************************************/
+/**
+ * Get the accounting info of all proc_table[] slots in one call.
+ * 
+ * @param buf  Array to accept the info, indexed by proc nr.
+ * @param nr   How many entries the array can hold.
+ * 
+ * @return How many entries have been filled.
+ *****************************************************************************/
+PUBLIC int getpstat(struct proc_stat * buf, int nr)
+{
+	MESSAGE msg;
+	msg.type	= GET_PROC_STAT;
+	msg.BUF		= buf;
+	msg.CNT		= nr;
+
+	send_recv(BOTH, TASK_SYS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.CNT;
+}
@@ -0,0 +1,77 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kinfo.c
+ * @brief  get_kinfo(), get_ticks()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+#define	KINFO_OFFSET(field)	((int)&((struct kinfo *)0)->field)
+
+PRIVATE u32 kinfo_word(int offset);
+
+/*****************************************************************************
+ *                                get_kinfo
+ *****************************************************************************/
+/**
+ * <Ring 1~3> Get a consistent copy of the caller's kernel info page. No
+ * message is sent.
+ * 
+ * @param k  Buffer to accept the page.
+ *****************************************************************************/
+PUBLIC void get_kinfo(struct kinfo * k)
+{
+	u32 * p = (u32*)k;
+	u32 seq;
+	int i;
+
+	/* the page may be updated under our feet, try again if it is */
+	do {
+		seq = kinfo_word(KINFO_OFFSET(seq));
+		for (i = 0; i < sizeof(struct kinfo) / 4; i++)
+			p[i] = kinfo_word(i * 4);
+	} while (kinfo_word(KINFO_OFFSET(seq)) != seq);
+}
+
+/*****************************************************************************
+ *                                get_ticks
+ *****************************************************************************/
+/**
+ * <Ring 1~3> Get the number of clock ticks since boot. No message is sent.
+ * 
+ * @return `ticks'.
+ *****************************************************************************/
+PUBLIC int get_ticks()
+{
+	return kinfo_word(KINFO_OFFSET(ticks));
+}
+
+/*****************************************************************************
+ *                                kinfo_word
+ *****************************************************************************/
+/**
+ * <Ring 1~3> Read a word from the caller's kernel info page.
+ * 
+ * @param offset  Where in struct kinfo.
+ * 
+ * @return The word.
+ *****************************************************************************/
+PRIVATE u32 kinfo_word(int offset)
+{
+	u32 w;
+	__asm__ __volatile__("movl %%fs:(%1), %0" : "=r"(w) : "r"(offset));
+	return w;
+}
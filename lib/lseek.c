@@ -41,7 +41,7 @@ PUBLIC int lseek(int fd, int offset, int whence)
 	msg.OFFSET = offset;
 	msg.WHENCE = whence;
 
-	send_recv(BOTH, TASK_FS, &msg);
+	send_recv_short(BOTH, TASK_FS, &msg);
 
 	return msg.OFFSET;
 }
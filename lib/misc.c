@@ -29,11 +29,13 @@
  * It is an encapsulation of `sendrec',
  * invoking `sendrec' directly should be avoided
  *
- * @param function  SEND, RECEIVE or BOTH
+ * @param function  SEND, RECEIVE, BOTH, SEND_ASYNC or RECEIVE_TIMED
  * @param src_dest  The caller's proc_nr
  * @param msg       Pointer to the MESSAGE struct
  * 
- * @return always 0.
+ * @return 0, MAILBOX_FULL if a SEND_ASYNC fails, or TIMED_OUT if a polling
+ *         RECEIVE_TIMED finds nothing. Use recv_timed() rather than
+ *         RECEIVE_TIMED directly.
  *****************************************************************************/
 PUBLIC int send_recv(int function, int src_dest, MESSAGE* msg)
 {
@@ -44,23 +46,162 @@ PUBLIC int send_recv(int function, int src_dest, MESSAGE* msg)
 
 	switch (function) {
 	case BOTH:
-		ret = sendrec(SEND, src_dest, msg);
-		if (ret == 0)
-			ret = sendrec(RECEIVE, src_dest, msg);
-		break;
 	case SEND:
 	case RECEIVE:
+	case SEND_ASYNC:
+	case RECEIVE_TIMED:
 		ret = sendrec(function, src_dest, msg);
 		break;
 	default:
-		assert((function == BOTH) ||
-		       (function == SEND) || (function == RECEIVE));
+		assert((function == BOTH) || (function == SEND) ||
+		       (function == RECEIVE) || (function == SEND_ASYNC) ||
+		       (function == RECEIVE_TIMED));
 		break;
 	}
 
 	return ret;
 }
 
+/*****************************************************************************
+ *                                send_async
+ *****************************************************************************/
+/**
+ * <Ring 1~3> Send a message without waiting for dest to receive it. It is
+ * queued in dest's mailbox if dest is busy. Only when the mailbox is full
+ * does the caller fall back to a blocking SEND, which throttles a sender
+ * that is faster than dest.
+ * 
+ * @param dest  To whom the message is sent.
+ * @param msg   Pointer to the MESSAGE struct
+ *****************************************************************************/
+PUBLIC void send_async(int dest, MESSAGE* msg)
+{
+	if (send_recv(SEND_ASYNC, dest, msg) == MAILBOX_FULL)
+		send_recv(SEND, dest, msg);
+}
+
+/*****************************************************************************
+ *                                send_async_vec
+ *****************************************************************************/
+/**
+ * <Ring 1~3> send_async() several msgs in one syscall: msgs[i] goes to
+ * dests[i]. As with send_async(), a msg whose dest's mailbox is full is
+ * sent by a blocking SEND, and the rest go on in another syscall.
+ * 
+ * @param n      How many msgs.
+ * @param dests  To whom the msgs are sent, none may be ANY or INTERRUPT.
+ * @param msgs   The msgs.
+ *****************************************************************************/
+PUBLIC void send_async_vec(int n, int* dests, MESSAGE* msgs)
+{
+	int i = 0;
+
+	assert(n > 0);
+
+	while (i < n) {
+		i += sendvec(n - i, dests + i, msgs + i);
+		if (i < n) {
+			send_recv(SEND, dests[i], &msgs[i]);
+			i++;
+		}
+	}
+}
+
+/*****************************************************************************
+ *                                recv_timed
+ *****************************************************************************/
+/**
+ * <Ring 1~3> RECEIVE, but give up after a while.
+ * 
+ * @param src       From whom, ANY or INTERRUPT.
+ * @param msg       Pointer to the MESSAGE struct
+ * @param nr_ticks  How long to wait at most. If it is 0, only the messages
+ *                  which are already there are looked at (a poll).
+ * 
+ * @return 0 if a message is received, TIMED_OUT if not. In the latter case
+ *         msg->type is RECV_TIMEOUT.
+ *****************************************************************************/
+PUBLIC int recv_timed(int src, MESSAGE* msg, int nr_ticks)
+{
+	memset(msg, 0, sizeof(MESSAGE));
+	msg->TIMEOUT = nr_ticks;
+
+	send_recv(RECEIVE_TIMED, src, msg);
+
+	/**
+	 * Don't trust the return value: if the time is up after the syscall
+	 * has returned zero, only the msg tells.
+	 */
+	return (msg->source == INTERRUPT && msg->type == RECV_TIMEOUT) ?
+		TIMED_OUT : 0;
+}
+
+/*****************************************************************************
+ *                                recv_timed_ns
+ *****************************************************************************/
+/**
+ * <Ring 1~3> The same as recv_timed(), with the time in nanoseconds. It is
+ * rounded up to whole ticks, so it never times out early.
+ * 
+ * @param src  From whom, ANY or INTERRUPT.
+ * @param msg  Pointer to the MESSAGE struct
+ * @param ns   How long to wait at most.
+ * 
+ * @return 0 if a message is received, TIMED_OUT if not.
+ *****************************************************************************/
+PUBLIC int recv_timed_ns(int src, MESSAGE* msg, u64 ns)
+{
+	u64 n = ns + 1000000000 / HZ - 1;
+	div64(&n, 1000000000 / HZ);
+
+	return recv_timed(src, msg, n > MAX_TICKS ? MAX_TICKS : (int)n);
+}
+
+/*****************************************************************************
+ *                                grant
+ *****************************************************************************/
+/**
+ * <Ring 1~3> Let another proc access a window of the caller's memory. The
+ * returned gid is passed to it in a MESSAGE, and should be revoked by
+ * rmgrant() once the request is done.
+ *
+ * @param grantee  Who may access the window.
+ * @param addr     Start of the window.
+ * @param len      Length of the window.
+ * @param rights   GRANT_READ and/or GRANT_WRITE.
+ *
+ * @return The gid, or NO_GRANT if failed.
+ *****************************************************************************/
+PUBLIC int grant(int grantee, void* addr, int len, int rights)
+{
+	return mkgrant(grantee << 2 | rights, addr, len);
+}
+
+/*****************************************************************************
+ *                                send_recv_short
+ *****************************************************************************/
+/**
+ * <Ring 1~3> The short version of send_recv(). Only msg->type and the first
+ * 4 words of msg->u (FD, OFFSET, WHENCE, DEVICE, ...) are transferred, in
+ * registers, so it suits small requests to a certain proc such as close(),
+ * lseek() and wait(). If a message is received, the rest of msg->u is
+ * left untouched.
+ * 
+ * @param function SEND, RECEIVE or BOTH
+ * @param src_dest The caller's proc_nr, must not be ANY or INTERRUPT.
+ * @param msg      Pointer to the MESSAGE struct
+ * 
+ * @return always 0.
+ *****************************************************************************/
+PUBLIC int send_recv_short(int function, int src_dest, MESSAGE* msg)
+{
+	assert(src_dest != ANY && src_dest != INTERRUPT);
+	assert((function == BOTH) ||
+	       (function == SEND) || (function == RECEIVE));
+
+	return sendrec_short(function, src_dest, msg);
+}
+
 /*****************************************************************************
  *                                memcmp
  *****************************************************************************/
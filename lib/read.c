@@ -39,8 +39,18 @@ PUBLIC int read(int fd, void *buf, int count)
 	msg.FD   = fd;
 	msg.BUF  = buf;
 	msg.CNT  = count;
+	/**
+	 * Let the disk driver put whole sectors right into buf. Not worth
+	 * the two extra syscalls for less than a sector.
+	 */
+	int gid = count >= SECTOR_SIZE ?
+		grant(TASK_FS, buf, count, GRANT_WRITE) : NO_GRANT;
+	msg.GRANT = gid;
 
 	send_recv(BOTH, TASK_FS, &msg);
 
+	if (gid != NO_GRANT)
+		rmgrant(gid);
+
 	return msg.CNT;
 }
@@ -0,0 +1,172 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   ring.c
+ * @brief  ring_setup(), ring_release(), ring_push(), ring_enter(),
+ *         ring_reap()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/**
+ * Usage:
+ *
+ *     struct fs_ring r;
+ *     ring_setup(&r);
+ *     ...fill MESSAGEs the way read(), write(), ... do, and ring_push() them
+ *     ring_enter(&r, 1);
+ *     while (ring_reap(&r, &cqe)) ...
+ *     ring_release(&r);
+ *
+ * @see fs/ring.c
+ */
+
+/*****************************************************************************
+ *                                ring_setup
+ *****************************************************************************/
+/**
+ * Register a request ring with FS. The ring is granted to FS until
+ * ring_release().
+ *
+ * @param r  The ring.
+ *
+ * @return Zero if success, -1 if the caller has a ring already or the ring
+ *         cannot be granted.
+ *****************************************************************************/
+PUBLIC int ring_setup(struct fs_ring * r)
+{
+	memset(r, 0, sizeof(struct fs_ring));
+
+	int gid = grant(TASK_FS, r, sizeof(struct fs_ring),
+			GRANT_READ | GRANT_WRITE);
+	if (gid == NO_GRANT)
+		return -1;
+
+	MESSAGE msg;
+	msg.type	= RING_SETUP;
+	msg.GRANT	= gid;
+
+	send_recv(BOTH, TASK_FS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	if (msg.RETVAL != 0)
+		rmgrant(gid);
+
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                ring_release
+ *****************************************************************************/
+/**
+ * Take the ring back from FS. Requests not entered yet are dropped.
+ *
+ * @param r  The ring.
+ *
+ * @return Zero.
+ *****************************************************************************/
+PUBLIC int ring_release(struct fs_ring * r)
+{
+	MESSAGE msg;
+	msg.type	= RING_SETUP;
+	msg.GRANT	= NO_GRANT;
+
+	send_recv(BOTH, TASK_FS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	if (msg.GRANT != NO_GRANT)
+		rmgrant(msg.GRANT);
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                ring_push
+ *****************************************************************************/
+/**
+ * Put a request into the ring. No message is sent.
+ *
+ * @param r          The ring.
+ * @param user_data  Given back with the result.
+ * @param m          The request, OPEN, CLOSE, READ, WRITE, LSEEK or STAT.
+ *                   m->GRANT of a READ or WRITE must be NO_GRANT or a
+ *                   grant of its buffer to FS, as read() and write() do.
+ *
+ * @return Zero if success, -1 if the ring is full.
+ *****************************************************************************/
+PUBLIC int ring_push(struct fs_ring * r, u32 user_data, MESSAGE * m)
+{
+	if (r->sq_tail - r->sq_head == NR_RING_ENTRIES)
+		return -1;
+
+	struct fs_sqe * sqe = &r->sq[r->sq_tail % NR_RING_ENTRIES];
+	sqe->user_data = user_data;
+	sqe->msg = *m;
+	r->sq_tail++;
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                ring_enter
+ *****************************************************************************/
+/**
+ * Ring the doorbell: have FS do the requests pushed.
+ *
+ * @param r     The ring.
+ * @param wait  If nonzero, return when FS has done them. Otherwise return
+ *              at once, and FS does them when it comes to the doorbell.
+ *
+ * @return How many results are waiting to be reaped if wait is nonzero,
+ *         otherwise zero.
+ *****************************************************************************/
+PUBLIC int ring_enter(struct fs_ring * r, int wait)
+{
+	MESSAGE msg;
+	msg.type	= RING_ENTER;
+	msg.FLAGS	= wait ? RING_WAIT : 0;
+
+	if (!wait) {
+		send_async(TASK_FS, &msg);
+		return 0;
+	}
+
+	send_recv(BOTH, TASK_FS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.CNT;
+}
+
+/*****************************************************************************
+ *                                ring_reap
+ *****************************************************************************/
+/**
+ * Take a result out of the ring. No message is sent.
+ *
+ * @param r    The ring.
+ * @param cqe  To accept the result.
+ *
+ * @return Nonzero if there is a result.
+ *****************************************************************************/
+PUBLIC int ring_reap(struct fs_ring * r, struct fs_cqe * cqe)
+{
+	if (r->cq_head == r->cq_tail)
+		return 0;
+
+	*cqe = r->cq[r->cq_head % NR_RING_ENTRIES];
+	r->cq_head++;
+
+	return 1;
+}
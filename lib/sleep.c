@@ -0,0 +1,78 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   sleep.c
+ * @brief  sleep(), usleep()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+PRIVATE int sleep_ticks(int nr);
+
+/*****************************************************************************
+ *                                sleep
+ *****************************************************************************/
+/**
+ * Block the caller for a number of seconds.
+ * 
+ * @param seconds  How long to sleep.
+ * 
+ * @return Zero.
+ *****************************************************************************/
+PUBLIC int sleep(int seconds)
+{
+	return sleep_ticks(seconds * HZ);
+}
+
+/*****************************************************************************
+ *                                usleep
+ *****************************************************************************/
+/**
+ * Block the caller for a number of microseconds. The time is rounded up
+ * to whole ticks.
+ * 
+ * @param usec  How long to sleep.
+ * 
+ * @return Zero.
+ *****************************************************************************/
+PUBLIC int usleep(int usec)
+{
+	return sleep_ticks((usec + 1000000 / HZ - 1) / (1000000 / HZ));
+}
+
+/*****************************************************************************
+ *                                sleep_ticks
+ *****************************************************************************/
+/**
+ * Ask TASK_SYS not to reply until some ticks later.
+ * 
+ * @param nr  How many ticks.
+ * 
+ * @return Zero.
+ *****************************************************************************/
+PRIVATE int sleep_ticks(int nr)
+{
+	if (nr <= 0)
+		return 0;
+
+	MESSAGE msg;
+	msg.type	= SLEEP_TICKS;
+	msg.CNT		= nr;
+
+	send_recv(BOTH, TASK_SYS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
@@ -0,0 +1,154 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   svcstat.c
+ * @brief  Service times of the servers.
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/**
+ * TASK FS, MM and HD each keep a table of struct svc_stat, one entry per msg
+ * type. Their main loops go like this:
+ *
+ *     send_recv(RECEIVE, ANY, &msg);
+ *     svc = svc_begin(tab, msg.type, &t0);
+ *     ...handle the msg...
+ *     svc_end(svc, t0);
+ *     ...reply...
+ *
+ * and a SVC_STAT msg gets the table, @see getsvcstat().
+ */
+
+/*****************************************************************************
+ *                                svc_begin
+ *****************************************************************************/
+/**
+ * <Ring 1> A server starts serving a msg: find the entry of the msg type and
+ * sample how many msgs are still waiting for the server.
+ *
+ * @param tab   The server's table, NR_SVC_TYPES entries.
+ * @param type  The msg type.
+ * @param t0    To accept the starting time.
+ *
+ * @return The entry, 0 if the table is full.
+ *****************************************************************************/
+PUBLIC struct svc_stat* svc_begin(struct svc_stat * tab, int type, u64 * t0)
+{
+	struct svc_stat * s;
+
+	for (s = tab; s < tab + NR_SVC_TYPES; s++)
+		if (s->type == type || s->type == 0)
+			break;
+	if (s == tab + NR_SVC_TYPES)
+		return 0;
+
+	if (s->type == 0) {
+		memset(s, 0, sizeof(struct svc_stat));
+		s->type = type;
+		s->min_ns = 0xFFFFFFFF;
+	}
+
+	/* TASKs run in ring 1 and may peek at their own proc_table[] slot */
+	struct proc * p = &proc_table[getpid()];
+	struct proc * q;
+	int depth = p->mb_cnt;
+	for (q = p->q_sending; q; q = q->next_sending)
+		depth++;
+	s->q_total += depth;
+	s->q_max = max(s->q_max, depth);
+
+	*t0 = clock_ns();
+
+	return s;
+}
+
+/*****************************************************************************
+ *                                svc_end
+ *****************************************************************************/
+/**
+ * <Ring 1> A server has done a msg, its reply is about to go.
+ *
+ * @param s   What svc_begin() returned.
+ * @param t0  The starting time svc_begin() gave.
+ *****************************************************************************/
+PUBLIC void svc_end(struct svc_stat * s, u64 t0)
+{
+	if (!s)
+		return;
+
+	u64 ns = clock_ns() - t0;
+	u32 t = ns > 0xFFFFFFFF ? 0xFFFFFFFF : ns;
+	int b = 0;
+
+	while (t >> (b + 1))
+		b++;
+
+	s->cnt++;
+	s->total_ns += ns;
+	s->min_ns = min(s->min_ns, t);
+	s->max_ns = max(s->max_ns, t);
+	s->hist[b]++;
+}
+
+/*****************************************************************************
+ *                                svc_query
+ *****************************************************************************/
+/**
+ * <Ring 1> Serve a SVC_STAT msg: copy the entries in use to the caller.
+ *
+ * @param tab  The server's table.
+ * @param m    The SVC_STAT msg, BUF and CNT are the caller's buffer.
+ *
+ * @return How many entries have been copied.
+ *****************************************************************************/
+PUBLIC int svc_query(struct svc_stat * tab, MESSAGE * m)
+{
+	struct svc_stat * buf = (struct svc_stat *)m->BUF;
+	int nr = min(m->CNT, NR_SVC_TYPES);
+	int i;
+
+	for (i = 0; i < nr && tab[i].type; i++)
+		phys_copy(va2la(m->source, buf + i),
+			  va2la(getpid(), tab + i),
+			  sizeof(struct svc_stat));
+
+	return i;
+}
+
+/*****************************************************************************
+ *                                getsvcstat
+ *****************************************************************************/
+/**
+ * Get the service times of a server, per msg type.
+ *
+ * @param server  TASK_FS, TASK_MM or TASK_HD.
+ * @param buf     Array to accept the info.
+ * @param nr      How many entries the array can hold.
+ *
+ * @return How many entries have been filled.
+ *****************************************************************************/
+PUBLIC int getsvcstat(int server, struct svc_stat * buf, int nr)
+{
+	MESSAGE msg;
+	msg.type	= SVC_STAT;
+	msg.BUF		= buf;
+	msg.CNT		= nr;
+
+	send_recv(BOTH, server, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.CNT;
+}
@@ -10,10 +10,20 @@
 INT_VECTOR_SYS_CALL equ 0x90
 _NR_printx	    equ 0
 _NR_sendrec	    equ 1
+_NR_halt	    equ 2
+_NR_sendrec_short   equ 3
+_NR_mkgrant	    equ 4
+_NR_rmgrant	    equ 5
+_NR_sendvec	    equ 6
 
 ; 导出符号
 global	printx
 global	sendrec
+global	halt
+global	sendrec_short
+global	mkgrant
+global	rmgrant
+global	sendvec
 
 bits 32
 [section .text]
@@ -39,6 +49,116 @@ sendrec:
 
 	ret
 
+; ====================================================================================
+;          sendrec_short(int function, int src_dest, MESSAGE* msg);
+; ====================================================================================
+; Never call sendrec_short() directly, call send_recv_short() instead.
+; Only msg->type and the first 4 words of msg->u go to the kernel, in
+; registers, so the kernel need not copy the whole MESSAGE.
+;
+;	ebx <- (src_dest << 2) | function
+;	ecx <- type
+;	edx, esi, edi, ebp <- u.m3.m3i1 .. u.m3.m3i4
+;
+; If a message is received, it comes back in the same registers, with the
+; source in ebx.
+sendrec_short:
+	push	ebx		; .
+	push	ecx		;  |
+	push	edx		;  |
+	push	esi		;   > 24 bytes
+	push	edi		;  |
+	push	ebp		; /
+
+	mov	eax, [esp + 24 + 12]	; msg
+	mov	ecx, [eax +  4]		; type
+	mov	edx, [eax +  8]		; u.m3.m3i1
+	mov	esi, [eax + 12]		; u.m3.m3i2
+	mov	edi, [eax + 16]		; u.m3.m3i3
+	mov	ebp, [eax + 20]		; u.m3.m3i4
+	mov	ebx, [esp + 24 +  8]	; src_dest
+	shl	ebx, 2
+	or	ebx, [esp + 24 +  4]	; function
+	mov	eax, _NR_sendrec_short
+	int	INT_VECTOR_SYS_CALL
+
+	test	dword [esp + 24 +  4], 2	; function & RECEIVE ?
+	jz	.done
+	push	eax
+	mov	eax, [esp + 4 + 24 + 12]	; msg
+	mov	[eax     ], ebx		; source
+	mov	[eax +  4], ecx		; type
+	mov	[eax +  8], edx
+	mov	[eax + 12], esi
+	mov	[eax + 16], edi
+	mov	[eax + 20], ebp
+	pop	eax
+.done:
+	pop	ebp
+	pop	edi
+	pop	esi
+	pop	edx
+	pop	ecx
+	pop	ebx
+
+	ret
+
+; ====================================================================================
+;          sendvec(int n, int* dests, MESSAGE* msgs);
+; ====================================================================================
+; Never call sendvec() directly, call send_async_vec() instead.
+sendvec:
+	push	ebx		; .
+	push	ecx		;  > 12 bytes
+	push	edx		; /
+
+	mov	eax, _NR_sendvec
+	mov	ebx, [esp + 12 +  4]	; n
+	mov	ecx, [esp + 12 +  8]	; dests
+	mov	edx, [esp + 12 + 12]	; msgs
+	int	INT_VECTOR_SYS_CALL
+
+	pop	edx
+	pop	ecx
+	pop	ebx
+
+	ret
+
+; ====================================================================================
+;        int mkgrant(int grantee_rights, void* addr, int len);
+; ====================================================================================
+; Never call mkgrant() directly, call grant() instead.
+mkgrant:
+	push	ebx		; .
+	push	ecx		;  > 12 bytes
+	push	edx		; /
+
+	mov	eax, _NR_mkgrant
+	mov	ebx, [esp + 12 +  4]	; (grantee << 2) | rights
+	mov	ecx, [esp + 12 +  8]	; addr
+	mov	edx, [esp + 12 + 12]	; len
+	int	INT_VECTOR_SYS_CALL
+
+	pop	edx
+	pop	ecx
+	pop	ebx
+
+	ret
+
+; ====================================================================================
+;                          int rmgrant(int gid);
+; ====================================================================================
+rmgrant:
+	push	ebx		; 4 bytes
+
+	mov	eax, _NR_rmgrant
+	mov	ebx, [esp + 4 + 4]	; gid
+	int	INT_VECTOR_SYS_CALL
+
+	pop	ebx
+
+	ret
+
 ; ====================================================================================
 ;                          void printx(char* s);
 ; ====================================================================================
@@ -53,3 +173,13 @@ printx:
 
 	ret
 
+; ====================================================================================
+;                          void halt();
+; ====================================================================================
+; Only TASK_IDLE may call this.
+halt:
+	mov	eax, _NR_halt
+	int	INT_VECTOR_SYS_CALL
+
+	ret
+
@@ -0,0 +1,200 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   time.c
+ * @brief  clock_ns(), gettimeofday()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+#define	SECS_PER_DAY	(24 * 60 * 60)
+
+PRIVATE u64 rdtsc();
+PRIVATE u64 tsc2ns(struct kinfo * k, u64 tsc);
+PRIVATE int leap(int year);
+PRIVATE int days_of_month(int year, int month);
+
+/*****************************************************************************
+ *                                clock_ns
+ *****************************************************************************/
+/**
+ * <Ring 1~3> Monotonic clock. No message is sent.
+ * 
+ * @return Nanoseconds since the TSC was calibrated at boot.
+ *****************************************************************************/
+PUBLIC u64 clock_ns()
+{
+	struct kinfo k;
+	get_kinfo(&k);
+
+	return tsc2ns(&k, rdtsc());
+}
+
+/*****************************************************************************
+ *                                gettimeofday
+ *****************************************************************************/
+/**
+ * <Ring 1~3> Wall clock: the RTC time read at boot plus the time elapsed
+ * since then. No message is sent and the CMOS is not touched.
+ * 
+ * @param tv  Buffer to accept the time.
+ * 
+ * @return Zero.
+ *****************************************************************************/
+PUBLIC int gettimeofday(struct timeval * tv)
+{
+	struct kinfo k;
+	get_kinfo(&k);
+
+	u64 ns = tsc2ns(&k, rdtsc()) - k.rtc_ns;
+	u32 rem = div64(&ns, 1000000000);
+
+	tv->tv_sec = k.rtc_sec + (u32)ns;
+	tv->tv_usec = rem / 1000;
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                time2sec
+ *****************************************************************************/
+/**
+ * <Ring 0~3> Convert a calendar time to seconds since 1970-01-01 00:00:00.
+ * 
+ * @param t  The calendar time.
+ * 
+ * @return Seconds.
+ *****************************************************************************/
+PUBLIC u32 time2sec(struct time * t)
+{
+	u32 days = 0;
+	int i;
+
+	for (i = 1970; i < t->year; i++)
+		days += leap(i) ? 366 : 365;
+	for (i = 1; i < t->month; i++)
+		days += days_of_month(t->year, i);
+	days += t->day - 1;
+
+	return ((days * 24 + t->hour) * 60 + t->minute) * 60 + t->second;
+}
+
+/*****************************************************************************
+ *                                sec2time
+ *****************************************************************************/
+/**
+ * <Ring 0~3> Convert seconds since 1970-01-01 00:00:00 to a calendar time.
+ * 
+ * @param sec  Seconds.
+ * @param t    Buffer to accept the calendar time.
+ *****************************************************************************/
+PUBLIC void sec2time(u32 sec, struct time * t)
+{
+	u32 days = sec / SECS_PER_DAY;
+
+	sec %= SECS_PER_DAY;
+	t->hour = sec / 3600;
+	t->minute = sec % 3600 / 60;
+	t->second = sec % 60;
+
+	for (t->year = 1970; days >= (leap(t->year) ? 366 : 365); t->year++)
+		days -= leap(t->year) ? 366 : 365;
+	for (t->month = 1; days >= days_of_month(t->year, t->month); t->month++)
+		days -= days_of_month(t->year, t->month);
+	t->day = days + 1;
+}
+
+/*****************************************************************************
+ *                                div64
+ *****************************************************************************/
+/**
+ * <Ring 0~3> Divide a u64 by a u32 without the help of libgcc.
+ * 
+ * @param n  The dividend, replaced by the quotient.
+ * @param d  The divisor.
+ * 
+ * @return The remainder.
+ *****************************************************************************/
+PUBLIC u32 div64(u64 * n, u32 d)
+{
+	u32 hi = *n >> 32;
+	u32 lo = *n;
+	u32 q_hi = hi / d;
+	u32 rem;
+
+	/* edx:eax / d, the quotient fits in 32 bits since edx < d */
+	__asm__("divl %4"
+		: "=a"(lo), "=d"(rem)
+		: "0"(lo), "1"(hi % d), "rm"(d));
+
+	*n = (u64)q_hi << 32 | lo;
+	return rem;
+}
+
+/*****************************************************************************
+ *                                rdtsc
+ *****************************************************************************/
+/**
+ * <Ring 0~3> Read the time-stamp counter.
+ * 
+ * @return TSC.
+ *****************************************************************************/
+PRIVATE u64 rdtsc()
+{
+	u64 tsc;
+	__asm__ __volatile__("rdtsc" : "=A"(tsc));
+	return tsc;
+}
+
+/*****************************************************************************
+ *                                tsc2ns
+ *****************************************************************************/
+/**
+ * <Ring 0~3> Convert a TSC value to clock_ns(), with the calibration result
+ * in the info page. 64-bit by 32-bit multiplication only.
+ * 
+ * @param k    The info page.
+ * @param tsc  TSC value.
+ * 
+ * @return Nanoseconds since boot.
+ *****************************************************************************/
+PRIVATE u64 tsc2ns(struct kinfo * k, u64 tsc)
+{
+	u64 cycles = tsc - k->boot_tsc;
+	u32 lo = cycles;
+	u32 hi = cycles >> 32;
+
+	return ((u64)lo * k->tsc_mult >> k->tsc_shift) +
+		((u64)hi * k->tsc_mult << (32 - k->tsc_shift));
+}
+
+/*****************************************************************************
+ *                                leap
+ *****************************************************************************/
+PRIVATE int leap(int year)
+{
+	return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+/*****************************************************************************
+ *                                days_of_month
+ *****************************************************************************/
+PRIVATE int days_of_month(int year, int month)
+{
+	static const int days[] = {31, 28, 31, 30, 31, 30,
+				   31, 31, 30, 31, 30, 31};
+
+	return (month == 2 && leap(year)) ? 29 : days[month - 1];
+}
@@ -0,0 +1,63 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   trace.c
+ * @brief  trace_ctl(), trace_dump()
+ * @author Forrest Y. Yu
+ * @date   2008
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+
+/*****************************************************************************
+ *                                trace_ctl
+ *****************************************************************************/
+/**
+ * Switch the kernel IPC trace on or off, or empty the ring.
+ * 
+ * @param req  TRACE_ON, TRACE_OFF or TRACE_CLEAR.
+ * 
+ * @return Whether the trace was on.
+ *****************************************************************************/
+PUBLIC int trace_ctl(int req)
+{
+	MESSAGE msg;
+	msg.type	= TRACE_CTL;
+	msg.REQUEST	= req;
+
+	send_recv(BOTH, TASK_SYS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                trace_dump
+ *****************************************************************************/
+/**
+ * Have FS write the IPC trace ring into the log sectors of the disk, where
+ * scripts/ipctrace can read it.
+ * 
+ * @return How many records are dumped.
+ *****************************************************************************/
+PUBLIC int trace_dump()
+{
+	MESSAGE msg;
+	msg.type	= TRACE_DUMP;
+
+	send_recv(BOTH, TASK_FS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
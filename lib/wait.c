@@ -34,7 +34,7 @@ PUBLIC int wait(int * status)
 	MESSAGE msg;
 	msg.type   = WAIT;
 
-	send_recv(BOTH, TASK_MM, &msg);
+	send_recv_short(BOTH, TASK_MM, &msg);
 
 	*status = msg.STATUS;
 
@@ -39,8 +39,22 @@ PUBLIC int write(int fd, const void *buf, int count)
 	msg.FD   = fd;
 	msg.BUF  = (void*)buf;
 	msg.CNT  = count;
+	/**
+	 * Let the disk driver take whole sectors right from buf. Not worth
+	 * the two extra syscalls for less than a sector.
+	 */
+	int gid = count >= SECTOR_SIZE ?
+		grant(TASK_FS, (void*)buf, count, GRANT_READ) : NO_GRANT;
+	msg.GRANT = gid;
 
 	send_recv(BOTH, TASK_FS, &msg);
 
+	/* FS has handed the write to a tty driver, which will reply */
+	if (msg.type == SUSPEND_PROC)
+		send_recv(RECEIVE, msg.PROC_NR, &msg);
+
+	if (gid != NO_GRANT)
+		rmgrant(gid);
+
 	return msg.CNT;
 }
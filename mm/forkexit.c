@@ -54,6 +54,25 @@ PUBLIC int do_fork()
 	p->ldt_sel = child_ldt_sel;
 	p->p_parent = pid;
 	sprintf(p->name, "%s_%d", proc_table[pid].name, child_pid);
+	/* the run queue links of the parent must not be inherited */
+	p->in_rq = 0;
+	p->next_ready = 0;
+	/* nor the senders waiting on it, and the priority they lent it */
+	if (p->q_boosted)
+		p->q_prio = p->q_own;
+	p->q_boosted = 0;
+	p->q_sending = p->q_sending_tail = 0;
+	p->next_sending = p->prev_sending = 0;
+	/* neither should the accounting */
+	p->user_ticks = p->sys_ticks = 0;
+	p->nr_vol_sw = p->nr_invol_sw = 0;
+	p->nr_sent = p->nr_recv = 0;
+	p->send_ticks = p->recv_ticks = 0;
+	/* nor the async msgs sent to the parent, or its grants */
+	p->mb_head = p->mb_cnt = p->mb_io_cnt = 0;
+	for (i = 0; i < NR_GRANTS; i++)
+		p->grants[i].g_rights = 0;
+	sched_sync(p);
 
 	/* duplicate the process: T, D & S */
 	struct descriptor * ppd;
@@ -111,6 +130,7 @@ PUBLIC int do_fork()
 		  child_base,
 		  (PROC_IMAGE_SIZE_DEFAULT - 1) >> LIMIT_4K_SHIFT,
 		  DA_LIMIT_4K | DA_32 | DA_DRW | PRIVILEGE_USER << 5);
+	init_kinfo(p);	/* not the parent's info page */
 
 	/* tell FS, see fs_fork() */
 	MESSAGE msg2fs;
@@ -191,10 +211,12 @@ PUBLIC void do_exit(int status)
 
 	if (proc_table[parent_pid].p_flags & WAITING) { /* parent is waiting */
 		proc_table[parent_pid].p_flags &= ~WAITING;
+		sched_sync(&proc_table[parent_pid]);
 		cleanup(&proc_table[pid]);
 	}
 	else { /* parent is not waiting */
 		proc_table[pid].p_flags |= HANGING;
+		sched_sync(&proc_table[pid]);
 	}
 
 	/* if the proc has any child, make INIT the new parent */
@@ -204,6 +226,7 @@ PUBLIC void do_exit(int status)
 			if ((proc_table[INIT].p_flags & WAITING) &&
 			    (proc_table[i].p_flags & HANGING)) {
 				proc_table[INIT].p_flags &= ~WAITING;
+				sched_sync(&proc_table[INIT]);
 				cleanup(&proc_table[i]);
 			}
 		}
@@ -226,9 +249,10 @@ PRIVATE void cleanup(struct proc * proc)
 	msg2parent.type = SYSCALL_RET;
 	msg2parent.PID = proc2pid(proc);
 	msg2parent.STATUS = proc->exit_status;
-	send_recv(SEND, proc->p_parent, &msg2parent);
+	send_async(proc->p_parent, &msg2parent);
 
 	proc->p_flags = FREE_SLOT;
+	sched_sync(proc);
 }
 
 /*****************************************************************************
@@ -270,6 +294,7 @@ PUBLIC void do_wait()
 	if (children) {
 		/* has children, but no child is HANGING */
 		proc_table[pid].p_flags |= WAITING;
+		sched_sync(&proc_table[pid]);
 	}
 	else {
 		/* no child at all */
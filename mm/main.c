@@ -25,6 +25,8 @@ PUBLIC void do_fork_test();
 
 PRIVATE void init_mm();
 
+PRIVATE struct svc_stat	mm_svc[NR_SVC_TYPES];
+
 /*****************************************************************************
  *                                task_mm
  *****************************************************************************/
@@ -43,6 +45,9 @@ PUBLIC void task_mm()
 
 		int msgtype = mm_msg.type;
 
+		u64 t0;
+		struct svc_stat * svc = svc_begin(mm_svc, msgtype, &t0);
+
 		switch (msgtype) {
 		case FORK:
 			mm_msg.RETVAL = do_fork();
@@ -58,15 +63,20 @@ PUBLIC void task_mm()
 			do_wait();
 			reply = 0;
 			break;
+		case SVC_STAT:
+			mm_msg.CNT = svc_query(mm_svc, &mm_msg);
+			break;
 		default:
 			dump_msg("MM::unknown msg", &mm_msg);
 			assert(0);
 			break;
 		}
 
+		svc_end(svc, t0);
+
 		if (reply) {
 			mm_msg.type = SYSCALL_RET;
-			send_recv(SEND, src, &mm_msg);
+			send_async(src, &mm_msg);
 		}
 	}
 }